@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../logic/ECS.h"
+#include "../logic/Time.h"
+
+///<summary>
+/// A standalone benchmark of the ECS. Every case is run for both storage modes and for entity counts from 1k up to
+/// the given maximum (1M by default). The results are printed as CSV, or as JSON if '--json' is passed, so that they can be
+/// compared between builds. Usage: ECSBenchmark [--json] [--max entity_count] [--repeat count]
+/// Build it as a console program from this file, logic/ECS.cpp, logic/Matrices.cpp and logic/ThreadPool.cpp, with optimizations enabled.
+///</summary>
+
+namespace bench {
+	using namespace flo;
+
+	struct VelocityComponent {
+		glm::vec2 vel = glm::vec2(0.);
+	};
+
+	struct Result {
+		std::string name, storage;
+		u32 entities, operations;
+		double milliseconds;
+	};
+
+	std::vector<Result> results;
+
+	///<summary>
+	/// The sum of all values read during the benchmarks, printed at the end so that no read can be optimized away.
+	///</summary>
+	double checksum = 0;
+
+	///<summary>
+	/// The source of the random orders, seeded identically for every run. rand() only covers 32768 values with MSVC.
+	///</summary>
+	std::mt19937 random(1);
+
+	const char* storageName(ComponentStorage storage) {
+		return storage == storage_archetype ? "archetype" : "reference";
+	}
+
+	void record(const char* name, ComponentStorage storage, u32 entities, u32 operations, Time time) {
+		Result result = { name, storageName(storage), entities, operations, time.asMilliseconds() };
+		results.push_back(result);
+	}
+
+	void setup(EntityComponentSystem& ecs, ComponentStorage storage) {
+		ecs.registerComponent<TransformComponent>(storage);
+		ecs.registerComponent<VelocityComponent>(storage);
+	}
+
+	void spawn(EntityComponentSystem& ecs, u32 count, std::vector<Entity>& entities) {
+		entities.reserve(entities.size() + count);
+		for (u32 i = 0; i < count; ++i) {
+			Entity entity = ecs.registerEntity();
+			TransformComponent* transform = ecs.emplace<TransformComponent>(entity);
+			transform->pos = glm::vec2(i, i * .5f);
+			transform->size = glm::vec2(1.);
+			//every other entity moves, so that single- and multi-component queries see different counts
+			if (i % 2 == 0) ecs.emplace<VelocityComponent>(entity)->vel = glm::vec2(1., -1.);
+			ecs.finalizeEntity();
+			entities.push_back(entity);
+		}
+		ecs.notifySystems();
+	}
+
+	void benchmarkCreateDestroy(ComponentStorage storage, u32 count) {
+		EntityComponentSystem ecs;
+		setup(ecs, storage);
+		std::vector<Entity> entities;
+
+		Stopclock clock;
+		spawn(ecs, count, entities);
+		record("create", storage, count, count, clock.stop());
+
+		clock.reset();
+		for (u32 i = 0; i < count; ++i) ecs.removeEntity(entities[i]);
+		ecs.notifySystems();
+		record("destroy_all", storage, count, count, clock.stop());
+
+		//the second round reuses recycled slots and already allocated memory
+		entities.clear();
+		clock.reset();
+		spawn(ecs, count, entities);
+		record("create_recycled", storage, count, count, clock.stop());
+
+		Prefab prefab;
+		TransformComponent transform;
+		transform.size = glm::vec2(1.);
+		prefab.set(transform);
+		prefab.set(VelocityComponent());
+		entities.clear();
+		clock.reset();
+		ecs.instantiate(prefab, count, entities);
+		ecs.notifySystems();
+		record("instantiate_prefab", storage, count, count, clock.stop());
+		prefab.dispose();
+		ecs.dispose();
+	}
+
+	void benchmarkIteration(ComponentStorage storage, u32 count, u32 repeat) {
+		EntityComponentSystem ecs;
+		setup(ecs, storage);
+		std::vector<Entity> entities;
+		spawn(ecs, count, entities);
+
+		//only every other entity has a velocity, so the two-component cases visit fewer entities
+		const u32 moving = ecs.view<const TransformComponent, const VelocityComponent>().size();
+		Stopclock clock;
+		for (u32 r = 0; r < repeat; ++r) {
+			ecs.view<const TransformComponent>().each([](Entity, const TransformComponent& transform) {
+				checksum += transform.pos.x;
+			});
+		}
+		record("iterate_one", storage, count, count, clock.stop() / (double)repeat);
+
+		clock.reset();
+		for (u32 r = 0; r < repeat; ++r) {
+			ecs.view<TransformComponent, const VelocityComponent>().each([](Entity, TransformComponent& transform, const VelocityComponent& velocity) {
+				transform.pos += velocity.vel * .016f;
+			});
+		}
+		record("iterate_two", storage, count, moving, clock.stop() / (double)repeat);
+
+		clock.reset();
+		for (u32 r = 0; r < repeat; ++r) {
+			ecs.view<TransformComponent, const VelocityComponent>().eachChunk([](u32 size, const Entity*, TransformComponent* transforms, const VelocityComponent* velocities) {
+				for (u32 i = 0; i < size; ++i) transforms[i].pos += velocities[i].vel * .016f;
+			});
+		}
+		record("iterate_two_chunked", storage, count, moving, clock.stop() / (double)repeat);
+		ecs.dispose();
+	}
+
+	void benchmarkRandomAccess(ComponentStorage storage, u32 count) {
+		EntityComponentSystem ecs;
+		setup(ecs, storage);
+		std::vector<Entity> entities;
+		spawn(ecs, count, entities);
+
+		std::vector<Entity> order(entities);
+		std::shuffle(order.begin(), order.end(), random);
+
+		const typehash type = uniqueCode<TransformComponent>();
+		Stopclock clock;
+		for (u32 i = 0; i < count; ++i) {
+			TransformComponent* transform = (TransformComponent*)ecs.getComponent(type, order[i]);
+			checksum += transform->pos.y;
+		}
+		record("get_component_random", storage, count, count, clock.stop());
+		ecs.dispose();
+	}
+
+	void benchmarkRemoval(ComponentStorage storage, u32 count) {
+		EntityComponentSystem ecs;
+		setup(ecs, storage);
+		std::vector<Entity> entities;
+		spawn(ecs, count, entities);
+
+		//remove a fixed amount of random entities, so that the cost per removal can be compared across entity counts
+		const u32 removals = std::min(count / 2, 1000u);
+		for (u32 i = 0; i < removals; ++i) std::swap(entities[i], entities[std::uniform_int_distribution<u32>(i, count - 1)(random)]);
+		Stopclock clock;
+		for (u32 i = 0; i < removals; ++i) ecs.removeEntity(entities[i]);
+		ecs.notifySystems();
+		record("remove_random", storage, count, removals, clock.stop());
+		ecs.dispose();
+	}
+
+	void printCSV() {
+		printf("benchmark,storage,entities,operations,milliseconds,nanoseconds_per_operation\n");
+		for (int i = 0; i < results.size(); ++i) {
+			const Result& r = results[i];
+			printf("%s,%s,%u,%u,%.4f,%.2f\n", r.name.c_str(), r.storage.c_str(), r.entities, r.operations, r.milliseconds, r.milliseconds * 1000000 / r.operations);
+		}
+	}
+
+	void printJSON() {
+		printf("{\n\t\"checksum\": %.1f,\n\t\"results\": [\n", checksum);
+		for (int i = 0; i < results.size(); ++i) {
+			const Result& r = results[i];
+			printf("\t\t{ \"benchmark\": \"%s\", \"storage\": \"%s\", \"entities\": %u, \"operations\": %u, \"milliseconds\": %.4f, \"nanoseconds_per_operation\": %.2f }%s\n",
+				r.name.c_str(), r.storage.c_str(), r.entities, r.operations, r.milliseconds, r.milliseconds * 1000000 / r.operations, i + 1 < results.size() ? "," : "");
+		}
+		printf("\t]\n}\n");
+	}
+}
+
+int main(int argc, char** argv) {
+	bool json = false;
+	u32 max_entities = 1000000, repeat = 10;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--json")) json = true;
+		else if (!strcmp(argv[i], "--max") && i + 1 < argc) max_entities = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--repeat") && i + 1 < argc) repeat = std::max(atoi(argv[++i]), 1);
+	}
+
+	const flo::ComponentStorage storages[] = { flo::storage_archetype, flo::storage_reference };
+	for (flo::ComponentStorage storage : storages) {
+		for (u32 count = 1000; count <= max_entities; count *= 10) {
+			bench::benchmarkCreateDestroy(storage, count);
+			bench::benchmarkIteration(storage, count, repeat);
+			bench::benchmarkRandomAccess(storage, count);
+			bench::benchmarkRemoval(storage, count);
+		}
+	}
+
+	if (json) bench::printJSON();
+	else {
+		bench::printCSV();
+		fprintf(stderr, "checksum %.1f\n", bench::checksum);
+	}
+	return 0;
+}
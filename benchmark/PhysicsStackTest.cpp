@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "../logic/Physics.h"
+
+///<summary>
+/// A standalone regression test of the contact solver. Columns of boxes are dropped onto an immovable floor with the default
+/// settings of PhysicsSystem and simulated for 20 seconds. A column passes if no box drifts sideways during the last 10 seconds
+/// and the column has fallen asleep by then. The exit code is the amount of failed columns. Usage: PhysicsStackTest [--verbose]
+/// Build it as a console program from this file and the sources of logic/ and graphics/, like the game itself.
+///</summary>
+
+namespace stacking {
+	using namespace flo;
+
+	const float frame_time = 1.f / 60.f;
+	const u32 frame_count = 1200;
+	const float max_drift = .01f;
+
+	struct Result {
+		u32 height;
+		float drift;
+		i32 sleep_frame;
+	};
+
+	TransformComponent& getTransform(EntityComponentSystem& ecs, Entity entity) {
+		return *(TransformComponent*)ecs.getComponent(uniqueCode<TransformComponent>(), entity);
+	}
+
+	///<summary>
+	/// Simulate a column of boxes resting on each other, each with an edge length of 2, a mass of 1 and the matching moment of inertia.
+	///</summary>
+	Result runColumn(u32 height, bool verbose) {
+		EntityComponentSystem ecs;
+		PhysicsSystem physics;
+		physics.gravity = glm::vec2(0., -10.);
+		ecs.registerSystem(&physics);
+		const u32 box = physics.addShape(Collider({ glm::vec2(-1, -1), glm::vec2(1, -1), glm::vec2(1, 1), glm::vec2(-1, 1) }));
+		const u32 floor = physics.addShape(Collider({ glm::vec2(-20, -1), glm::vec2(20, -1), glm::vec2(20, 1), glm::vec2(-20, 1) }));
+
+		std::vector<Entity> entities;
+		for (u32 i = 0; i <= height; ++i) {
+			Entity entity = ecs.registerEntity();
+			TransformComponent* transform = ecs.emplace<TransformComponent>(entity);
+			transform->pos = glm::vec2(0., i * 2.f);
+			transform->size = glm::vec2(1.);
+			//the first body is the floor
+			if (i) ecs.emplace<PhysicsComponent>(entity, 2.f / 3.f, 1.f);
+			else ecs.emplace<PhysicsComponent>(entity, 0.f, 0.f);
+			ecs.finalizeEntity();
+			entities.push_back(entity);
+		}
+		ecs.notifySystems();
+		for (u32 i = 0; i <= height; ++i) {
+			PhysicsComponent* body = (PhysicsComponent*)ecs.getComponent(uniqueCode<PhysicsComponent>(), entities[i]);
+			body->assignComponents(i ? box : floor, getTransform(ecs, entities[i]));
+		}
+
+		Result result = { height, 0, -1 };
+		std::vector<float> settled(height + 1);
+		for (u32 frame = 0; frame < frame_count; ++frame) {
+			ecs.runSystems(frame_time);
+			if (result.sleep_frame < 0 && physics.active_count == 0) result.sleep_frame = frame;
+			for (u32 i = 1; i <= height; ++i) {
+				const float x = getTransform(ecs, entities[i]).pos.x;
+				if (frame == frame_count / 2) settled[i] = x;
+				else if (frame > frame_count / 2) result.drift = std::max(result.drift, std::abs(x - settled[i]));
+			}
+			if (verbose && frame % 60 == 59) {
+				const TransformComponent& top = getTransform(ecs, entities.back());
+				printf("height %u, %.0f s: top at (%.4f, %.4f), %u bodies awake\n", height, (frame + 1) * frame_time, top.pos.x, top.pos.y, physics.active_count);
+			}
+		}
+		ecs.dispose();
+		return result;
+	}
+}
+
+int main(int argc, char** argv) {
+	bool verbose = false;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--verbose")) verbose = true;
+	}
+
+	const u32 heights[] = { 1, 4, 8, 12 };
+	int failed = 0;
+	for (u32 height : heights) {
+		const stacking::Result result = stacking::runColumn(height, verbose);
+		//a column that is still awake at the end has not come to rest, even if it happens to sway very little
+		const bool passed = result.drift <= stacking::max_drift && result.sleep_frame >= 0 && result.sleep_frame < (i32)(stacking::frame_count / 2);
+		printf("%s: %u boxes, drift %.4f, asleep after %d frames\n", passed ? "passed" : "FAILED", height, result.drift, result.sleep_frame);
+		if (!passed) ++failed;
+	}
+	return failed;
+}
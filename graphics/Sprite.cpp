@@ -158,6 +158,34 @@ namespace fgr {
 		graphics_check_error();
 	}
 
+	Sprite* SpriteArray::mapInstances(uint count) {
+		//mapping an empty range is an error in OpenGL
+		if (count == 0) return nullptr;
+		graphics_check_external();
+
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		if (count > instances_allocted) {
+			instances_allocted = (count & ~1023) + 1024;
+			glBufferData(GL_ARRAY_BUFFER, instances_allocted * sizeof(Sprite), NULL, GL_DYNAMIC_DRAW);
+		}
+		Sprite* mapped = (Sprite*)glMapBufferRange(GL_ARRAY_BUFFER, 0, count * sizeof(Sprite), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		instances_mapped = mapped != nullptr;
+
+		graphics_check_error();
+		return mapped;
+	}
+
+	void SpriteArray::unmapInstances() {
+		if (!instances_mapped) return;
+		instances_mapped = false;
+		graphics_check_external();
+
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+
+		graphics_check_error();
+	}
+
 	void SpriteArray::setTransformations(const glm::mat3& transform) {
 		rectangle.setTransformations(transform);
 	}
@@ -33,6 +33,7 @@ namespace fgr {
 		uint instances_allocted = 0;
 		uint batch_start = 0;
 		bool update_required, push_required;
+		bool instances_mapped = false;
 		VertexArray rectangle;
 
 		public:
@@ -91,6 +92,19 @@ namespace fgr {
         ///</summary>
 		void update();
 
+		///<summary>
+		///Map the instance buffer, so that sprites can be written into it directly instead of into "sprites" first.
+		///The previous contents are discarded, so every field of all 'count' sprites has to be written. Call "unmapInstances()" before drawing.
+		///</summary>
+		///<param name="count">The amount of sprites that will be written.</param>
+		///<returns>A pointer to the mapped sprites, or nullptr if 'count' is 0 or mapping failed.</returns>
+		Sprite* mapInstances(uint count);
+
+		///<summary>
+		///Unmap the instance buffer after "mapInstances()". Draw with "draw(shader, count)" afterwards. Does nothing if nothing has been mapped.
+		///</summary>
+		void unmapInstances();
+
         ///<summary>
         ///Draw the array.
         ///</summary>
@@ -0,0 +1,364 @@
+#include "Broadphase.h"
+
+#include <algorithm>
+#include <queue>
+
+namespace flo {
+	AABB::AABB(glm::vec2 min, glm::vec2 max) :
+	min(min), max(max) {
+	}
+
+	bool AABB::overlaps(const AABB& other) const {
+		return min.x <= other.max.x && max.x >= other.min.x && min.y <= other.max.y && max.y >= other.min.y;
+	}
+
+	bool AABB::contains(const AABB& other) const {
+		return min.x <= other.min.x && min.y <= other.min.y && max.x >= other.max.x && max.y >= other.max.y;
+	}
+
+	float AABB::perimeter() const {
+		return 2.f * (max.x - min.x + max.y - min.y);
+	}
+
+	AABB AABB::merge(const AABB& other) const {
+		return AABB(glm::min(min, other.min), glm::max(max, other.max));
+	}
+
+	u32 hashCell(i32 x, i32 y) {
+		return (u32)x * 73856093u ^ (u32)y * 19349663u;
+	}
+
+	void SpatialHash::findPairs(const AABB* boxes, u32 count, std::vector<u64>& pairs, u32 active_count) {
+		pairs.clear();
+		entries.clear();
+		oversized.clear();
+		if (!count) return;
+
+		float size = cell_size;
+		if (size <= 0) {
+			float extent = 0;
+			for (u32 i = 0; i < count; ++i) extent += glm::max(boxes[i].max.x - boxes[i].min.x, boxes[i].max.y - boxes[i].min.y);
+			size = glm::max(extent / count * 2.f, 1e-3f);
+		}
+		const float inverse_size = 1.f / size;
+
+		for (u32 i = 0; i < count; ++i) {
+			const i32 x0 = (i32)glm::floor(boxes[i].min.x * inverse_size), x1 = (i32)glm::floor(boxes[i].max.x * inverse_size);
+			const i32 y0 = (i32)glm::floor(boxes[i].min.y * inverse_size), y1 = (i32)glm::floor(boxes[i].max.y * inverse_size);
+			if ((u64)(x1 - x0 + 1) * (u64)(y1 - y0 + 1) > max_cells_per_box) {
+				oversized.push_back(i);
+				continue;
+			}
+			for (i32 y = y0; y <= y1; ++y) {
+				for (i32 x = x0; x <= x1; ++x) entries.push_back((u64)hashCell(x, y) << 32 | i);
+			}
+		}
+		std::sort(entries.begin(), entries.end());
+
+		for (u32 begin = 0; begin < entries.size();) {
+			const u32 key = entries[begin] >> 32;
+			u32 end = begin + 1;
+			while (end < entries.size() && entries[end] >> 32 == key) ++end;
+
+			for (u32 i = begin; i < end; ++i) {
+				//two cells of one box may share a hash
+				if (i > begin && entries[i] == entries[i - 1]) continue;
+				const u32 a = (u32)entries[i];
+				for (u32 j = i + 1; j < end; ++j) {
+					if (entries[j] == entries[j - 1]) continue;
+					const u32 b = (u32)entries[j];
+					if ((a >= active_count && b >= active_count) || !boxes[a].overlaps(boxes[b])) continue;
+					//a pair sharing several cells is only reported by the cell holding the lower corner of the overlap
+					const glm::vec2 corner = glm::max(boxes[a].min, boxes[b].min) * inverse_size;
+					if (hashCell((i32)glm::floor(corner.x), (i32)glm::floor(corner.y)) != key) continue;
+					pairs.push_back((u64)a << 32 | b);
+				}
+			}
+			begin = end;
+		}
+
+		//oversized boxes are in no cell, so they are paired with every box here; two oversized boxes are paired once
+		for (u32 o = 0; o < oversized.size(); ++o) {
+			const u32 a = oversized[o];
+			for (u32 b = 0; b < count; ++b) {
+				if (b == a || (a >= active_count && b >= active_count) || !boxes[a].overlaps(boxes[b])) continue;
+				if (b < a && std::binary_search(oversized.begin(), oversized.end(), b)) continue;
+				pairs.push_back(a < b ? (u64)a << 32 | b : (u64)b << 32 | a);
+			}
+		}
+		std::sort(pairs.begin(), pairs.end());
+	}
+
+	bool TreeNode::isLeaf() const {
+		return height == 0;
+	}
+
+	u32 DynamicTree::createProxy(const AABB& box, u64 user) {
+		const u32 proxy = allocateNode();
+		nodes[proxy].box = AABB(box.min - glm::vec2(margin), box.max + glm::vec2(margin));
+		nodes[proxy].user = user;
+		nodes[proxy].height = 0;
+		insertLeaf(proxy);
+		return proxy;
+	}
+
+	void DynamicTree::destroyProxy(u32 proxy) {
+		removeLeaf(proxy);
+		freeNode(proxy);
+	}
+
+	bool DynamicTree::moveProxy(u32 proxy, const AABB& box, glm::vec2 displacement) {
+		if (nodes[proxy].box.contains(box)) return false;
+
+		removeLeaf(proxy);
+		AABB fat(box.min - glm::vec2(margin), box.max + glm::vec2(margin));
+		const glm::vec2 d = displacement * displacement_factor;
+		fat.min += glm::min(d, glm::vec2(0.));
+		fat.max += glm::max(d, glm::vec2(0.));
+		nodes[proxy].box = fat;
+		insertLeaf(proxy);
+		return true;
+	}
+
+	void DynamicTree::query(const AABB& box, std::vector<u32>& proxies) const {
+		if (root == null_node) return;
+		u32 stack[max_stack_size];
+		u32 stack_size = 0;
+		stack[stack_size++] = root;
+		while (stack_size) {
+			const u32 index = stack[--stack_size];
+			const TreeNode& node = nodes[index];
+			if (!node.box.overlaps(box)) continue;
+			if (node.isLeaf()) proxies.push_back(index);
+			else {
+				stack[stack_size++] = node.children[0];
+				stack[stack_size++] = node.children[1];
+			}
+		}
+	}
+
+	u32 DynamicTree::raycast(glm::vec2 origin, glm::vec2 direction, float max_distance, const std::function<float(u32 proxy, float max_distance)>& test, float& distance) const {
+		u32 result = null_node;
+		distance = max_distance;
+		if (root == null_node) return result;
+
+		const glm::vec2 inverse_direction = glm::vec2(1.) / direction;
+		u32 stack[max_stack_size];
+		u32 stack_size = 0;
+		stack[stack_size++] = root;
+		while (stack_size) {
+			const u32 index = stack[--stack_size];
+			const TreeNode& node = nodes[index];
+
+			//slab test against the part of the ray that is still of interest
+			float enter = 0, exit = distance;
+			bool missed = false;
+			for (int axis = 0; axis < 2 && !missed; ++axis) {
+				if (direction[axis] == 0) {
+					//a ray parallel to a slab lies inside it everywhere or nowhere; the division would give 0 * inf = NaN on its border
+					missed = origin[axis] < node.box.min[axis] || origin[axis] > node.box.max[axis];
+					continue;
+				}
+				const float t0 = (node.box.min[axis] - origin[axis]) * inverse_direction[axis];
+				const float t1 = (node.box.max[axis] - origin[axis]) * inverse_direction[axis];
+				enter = glm::max(enter, glm::min(t0, t1));
+				exit = glm::min(exit, glm::max(t0, t1));
+			}
+			if (missed || enter > exit) continue;
+
+			if (node.isLeaf()) {
+				const float hit = test(index, distance);
+				if (hit >= 0 && hit <= distance) {
+					distance = hit;
+					result = index;
+				}
+			}
+			else {
+				stack[stack_size++] = node.children[0];
+				stack[stack_size++] = node.children[1];
+			}
+		}
+		return result;
+	}
+
+	float distanceToBox(const AABB& box, glm::vec2 point) {
+		return glm::length(glm::max(glm::max(box.min - point, point - box.max), glm::vec2(0.)));
+	}
+
+	u32 DynamicTree::nearest(glm::vec2 point, float max_distance, const std::function<float(u32 proxy)>& test, float& distance) const {
+		u32 result = null_node;
+		distance = max_distance;
+		if (root == null_node) return result;
+
+		typedef std::pair<float, u32> Candidate;
+		std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> queue;
+		queue.push(Candidate(distanceToBox(nodes[root].box, point), root));
+		while (!queue.empty()) {
+			const Candidate candidate = queue.top();
+			queue.pop();
+			//every node left is at least as far away as this one
+			if (candidate.first > distance) break;
+
+			const TreeNode& node = nodes[candidate.second];
+			if (node.isLeaf()) {
+				const float d = test(candidate.second);
+				if (d >= 0 && d <= distance) {
+					distance = d;
+					result = candidate.second;
+				}
+			}
+			else {
+				for (int i = 0; i < 2; ++i) {
+					const float d = distanceToBox(nodes[node.children[i]].box, point);
+					if (d <= distance) queue.push(Candidate(d, node.children[i]));
+				}
+			}
+		}
+		return result;
+	}
+
+	void DynamicTree::dispose() {
+		nodes.clear();
+		nodes.shrink_to_fit();
+		root = null_node;
+		free_list = null_node;
+	}
+
+	u32 DynamicTree::allocateNode() {
+		u32 node;
+		if (free_list == null_node) {
+			node = nodes.size();
+			nodes.push_back(TreeNode());
+		}
+		else {
+			node = free_list;
+			free_list = nodes[node].parent;
+		}
+		nodes[node].parent = null_node;
+		nodes[node].children[0] = nodes[node].children[1] = null_node;
+		nodes[node].height = 0;
+		return node;
+	}
+
+	void DynamicTree::freeNode(u32 node) {
+		nodes[node].parent = free_list;
+		nodes[node].height = -1;
+		free_list = node;
+	}
+
+	void DynamicTree::insertLeaf(u32 leaf) {
+		if (root == null_node) {
+			root = leaf;
+			nodes[leaf].parent = null_node;
+			return;
+		}
+
+		//descend towards the sibling that increases the total perimeter the least
+		const AABB box = nodes[leaf].box;
+		u32 index = root;
+		while (!nodes[index].isLeaf()) {
+			const TreeNode& node = nodes[index];
+			const float perimeter = node.box.perimeter();
+			const float combined = node.box.merge(box).perimeter();
+			//the cost of pairing the leaf with this node, and the cost pushed down to the children if descending
+			const float cost = 2.f * combined;
+			const float inherited = 2.f * (combined - perimeter);
+
+			float child_costs[2];
+			for (int i = 0; i < 2; ++i) {
+				const TreeNode& child = nodes[node.children[i]];
+				const float merged = child.box.merge(box).perimeter();
+				child_costs[i] = (child.isLeaf() ? merged : merged - child.box.perimeter()) + inherited;
+			}
+			if (cost < child_costs[0] && cost < child_costs[1]) break;
+			index = child_costs[0] < child_costs[1] ? node.children[0] : node.children[1];
+		}
+
+		const u32 sibling = index;
+		const u32 old_parent = nodes[sibling].parent;
+		const u32 new_parent = allocateNode();
+		nodes[new_parent].parent = old_parent;
+		nodes[new_parent].box = nodes[sibling].box.merge(box);
+		nodes[new_parent].height = nodes[sibling].height + 1;
+		nodes[new_parent].children[0] = sibling;
+		nodes[new_parent].children[1] = leaf;
+		nodes[sibling].parent = new_parent;
+		nodes[leaf].parent = new_parent;
+
+		if (old_parent == null_node) root = new_parent;
+		else {
+			TreeNode& parent = nodes[old_parent];
+			parent.children[parent.children[0] == sibling ? 0 : 1] = new_parent;
+		}
+		refit(new_parent);
+	}
+
+	void DynamicTree::removeLeaf(u32 leaf) {
+		if (leaf == root) {
+			root = null_node;
+			return;
+		}
+
+		const u32 parent = nodes[leaf].parent;
+		const u32 grandparent = nodes[parent].parent;
+		const u32 sibling = nodes[parent].children[nodes[parent].children[0] == leaf ? 1 : 0];
+		freeNode(parent);
+		nodes[sibling].parent = grandparent;
+		if (grandparent == null_node) root = sibling;
+		else {
+			TreeNode& node = nodes[grandparent];
+			node.children[node.children[0] == parent ? 0 : 1] = sibling;
+			refit(grandparent);
+		}
+	}
+
+	void DynamicTree::refit(u32 node) {
+		while (node != null_node) {
+			node = balance(node);
+			TreeNode& current = nodes[node];
+			const TreeNode& a = nodes[current.children[0]];
+			const TreeNode& b = nodes[current.children[1]];
+			current.height = 1 + glm::max(a.height, b.height);
+			current.box = a.box.merge(b.box);
+			node = current.parent;
+		}
+	}
+
+	u32 DynamicTree::balance(u32 a) {
+		TreeNode& node_a = nodes[a];
+		if (node_a.isLeaf() || node_a.height < 2) return a;
+
+		const u32 b = node_a.children[0], c = node_a.children[1];
+		TreeNode& node_b = nodes[b];
+		TreeNode& node_c = nodes[c];
+		const i32 difference = node_c.height - node_b.height;
+		if (difference >= -1 && difference <= 1) return a;
+
+		//the higher child takes the place of a, a takes the place of the higher child's lower child
+		const u32 up = difference > 1 ? c : b;
+		const int side = difference > 1 ? 1 : 0;
+		TreeNode& node_up = nodes[up];
+		const u32 other = node_a.children[1 - side];
+		const u32 f = node_up.children[0], g = node_up.children[1];
+		const bool keep_f = nodes[f].height > nodes[g].height;
+		const u32 kept = keep_f ? f : g, moved = keep_f ? g : f;
+
+		node_up.children[0] = a;
+		node_up.children[1] = kept;
+		node_up.parent = node_a.parent;
+		node_a.parent = up;
+		if (node_up.parent == null_node) root = up;
+		else {
+			TreeNode& parent = nodes[node_up.parent];
+			parent.children[parent.children[0] == a ? 0 : 1] = up;
+		}
+
+		node_a.children[side] = moved;
+		nodes[moved].parent = a;
+		node_a.box = nodes[other].box.merge(nodes[moved].box);
+		node_a.height = 1 + glm::max(nodes[other].height, nodes[moved].height);
+		node_up.box = node_a.box.merge(nodes[kept].box);
+		node_up.height = 1 + glm::max(node_a.height, nodes[kept].height);
+		return up;
+	}
+}
@@ -0,0 +1,210 @@
+#pragma once
+#include <vector>
+#include <functional>
+
+#include "Types.h"
+#include "Matrices.h"
+
+namespace flo {
+	///<summary>
+	/// An axis aligned bounding box.
+	///</summary>
+	struct AABB {
+		glm::vec2 min = glm::vec2(0.), max = glm::vec2(0.);
+
+		AABB() = default;
+
+		AABB(glm::vec2 min, glm::vec2 max);
+
+		bool overlaps(const AABB& other) const;
+
+		bool contains(const AABB& other) const;
+
+		float perimeter() const;
+
+		AABB merge(const AABB& other) const;
+	};
+
+	///<summary>
+	/// A uniform grid broadphase. Every box is put into each cell it covers, with the cells hashed into 32 bits,
+	/// and only boxes sharing a cell are tested against each other. The grid is rebuilt from scratch on every query,
+	/// which is one linear pass and a sort, so no per-body state has to be kept in sync.
+	/// Boxes much larger than a cell cover many cells, so scenes with very mixed body sizes should use a coarser cell size.
+	///</summary>
+	struct SpatialHash {
+		///<summary>
+		/// The edge length of a cell. If 0, twice the average box extent of every query is used.
+		///</summary>
+		float cell_size = 0;
+
+		///<summary>
+		/// The largest amount of cells a box is inserted into. Larger boxes, e.g. a long static floor, are tested against every box instead.
+		///</summary>
+		u32 max_cells_per_box = 64;
+
+		///<summary>
+		/// The cell hash of every inserted box in the upper 32 bits and the index of the box in the lower 32 bits, sorted. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u64> entries;
+
+		///<summary>
+		/// The indices of the boxes that cover more than max_cells_per_box cells and are therefore tested against every box. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u32> oversized;
+
+		SpatialHash() = default;
+
+		///<summary>
+		/// Find all pairs of overlapping boxes.
+		///</summary>
+		///<param name="boxes">The boxes to test.</param>
+		///<param name="count">The amount of boxes.</param>
+		///<param name="pairs">Outputs the index pairs, the smaller index in the upper 32 bits and the larger one in the lower 32 bits. The pairs are sorted, so the order does not depend on the grid.</param>
+		///<param name="active_count">The boxes from this index on are passive, e.g. sleeping or immovable bodies, and are not paired with each other.</param>
+		void findPairs(const AABB* boxes, u32 count, std::vector<u64>& pairs, u32 active_count = ~0u);
+	};
+
+	///<summary>
+	/// A node of a DynamicTree. Leaves hold the boxes inserted into the tree, inner nodes the union of their children.
+	///</summary>
+	struct TreeNode {
+		AABB box;
+
+		///<summary>
+		/// The value the leaf was created with.
+		///</summary>
+		u64 user = 0;
+
+		///<summary>
+		/// The parent, or the next free node if the node is unused.
+		///</summary>
+		u32 parent;
+
+		u32 children[2];
+
+		///<summary>
+		/// 0 for leaves, -1 for unused nodes.
+		///</summary>
+		i32 height = -1;
+
+		bool isLeaf() const;
+	};
+
+	///<summary>
+	/// A dynamic bounding volume hierarchy. Every leaf stores a box enlarged by a margin and by the movement of its owner,
+	/// so that a leaf only has to be reinserted once its owner leaves the enlarged box. Insertion picks the sibling that
+	/// grows the tree's perimeter the least, and the ancestors of changed leaves are rebalanced by rotations, so queries take O(log n).
+	///</summary>
+	struct DynamicTree {
+		static const u32 null_node = 0xffffffff;
+
+		///<summary>
+		/// The size of the traversal stacks. A depth-first traversal never holds more than the tree's height plus one nodes,
+		/// and the balancing keeps the height below 1.44 * log2(leaves), so this suffices for any tree that fits in memory.
+		///</summary>
+		static const u32 max_stack_size = 64;
+
+		///<summary>
+		/// The nodes, indexed by proxy. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<TreeNode> nodes;
+
+		///<summary>
+		/// The root node. WARNING: READ-ONLY!
+		///</summary>
+		u32 root = null_node;
+
+		///<summary>
+		/// The head of the list of unused nodes. WARNING: READ-ONLY!
+		///</summary>
+		u32 free_list = null_node;
+
+		///<summary>
+		/// The distance by which leaf boxes are enlarged on every side.
+		///</summary>
+		float margin = .1f;
+
+		///<summary>
+		/// How many steps of movement a leaf box is enlarged by in the direction of movement.
+		///</summary>
+		float displacement_factor = 2.f;
+
+		DynamicTree() = default;
+
+		///<summary>
+		/// Insert a box.
+		///</summary>
+		///<param name="box">The box.</param>
+		///<param name="user">A value to associate with the box, e.g. an entity.</param>
+		///<returns>The proxy of the box, which stays valid until it is destroyed.</returns>
+		u32 createProxy(const AABB& box, u64 user);
+
+		///<summary>
+		/// Remove a box.
+		///</summary>
+		///<param name="proxy">The proxy of the box.</param>
+		void destroyProxy(u32 proxy);
+
+		///<summary>
+		/// Update a box. The leaf is only reinserted if the new box is not contained by the enlarged one.
+		///</summary>
+		///<param name="proxy">The proxy of the box.</param>
+		///<param name="box">The new box.</param>
+		///<param name="displacement">The movement expected until the next update.</param>
+		///<returns>True if the leaf has been reinserted.</returns>
+		bool moveProxy(u32 proxy, const AABB& box, glm::vec2 displacement);
+
+		///<summary>
+		/// Find all leaves whose enlarged box overlaps a box.
+		///</summary>
+		///<param name="box">The box to test.</param>
+		///<param name="proxies">Outputs the proxies. The vector is not cleared.</param>
+		void query(const AABB& box, std::vector<u32>& proxies) const;
+
+		///<summary>
+		/// Cast a ray through the tree.
+		///</summary>
+		///<param name="origin">The start of the ray.</param>
+		///<param name="direction">The normalized direction of the ray.</param>
+		///<param name="max_distance">The length of the ray.</param>
+		///<param name="test">Called for every leaf the ray reaches with its proxy and the current length of the ray. It returns the distance at which the ray hits the owner of the leaf, or a negative value if it misses.</param>
+		///<param name="distance">Outputs the distance of the closest hit.</param>
+		///<returns>The proxy of the closest hit, null_node if nothing has been hit.</returns>
+		u32 raycast(glm::vec2 origin, glm::vec2 direction, float max_distance, const std::function<float(u32 proxy, float max_distance)>& test, float& distance) const;
+
+		///<summary>
+		/// Find the leaf closest to a point. Nodes are visited closest first, and subtrees farther away than the best leaf so far are skipped.
+		///</summary>
+		///<param name="point">The point.</param>
+		///<param name="max_distance">The largest distance to consider.</param>
+		///<param name="test">Called for candidate leaves with their proxy. It returns the distance from the point to the owner of the leaf, or a negative value to skip it.</param>
+		///<param name="distance">Outputs the distance of the closest leaf.</param>
+		///<returns>The proxy of the closest leaf, null_node if there is none within the maximum distance.</returns>
+		u32 nearest(glm::vec2 point, float max_distance, const std::function<float(u32 proxy)>& test, float& distance) const;
+
+		///<summary>
+		/// Remove all boxes.
+		///</summary>
+		void dispose();
+
+	private:
+		u32 allocateNode();
+
+		void freeNode(u32 node);
+
+		void insertLeaf(u32 leaf);
+
+		void removeLeaf(u32 leaf);
+
+		///<summary>
+		/// Refit and rebalance all ancestors of a node.
+		///</summary>
+		void refit(u32 node);
+
+		///<summary>
+		/// Rotate the higher grandchild up if the heights of a node's children differ by more than one.
+		///</summary>
+		///<returns>The node now in the place of the given one.</returns>
+		u32 balance(u32 node);
+	};
+}
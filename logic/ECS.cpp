@@ -1,50 +1,250 @@
 #include "ECS.h"
+#include "SimdMath.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
 
 namespace flo {
 	const u32 invalid_index = -1;
 	const int data_chunk_size = 8192;
 
-	Entity to2Power(Entity e) {
-		Entity e2 = 1, e3 = 1;
-		while (e2 < e) {
-			e3 = e2;
-			e2 <<= 1;
+	u32 SparseIndex::get(Entity entity) const {
+		const u32 page = entityIndex(entity) / page_size;
+		if (page >= pages.size() || pages[page].empty()) return invalid_index;
+		return pages[page][entityIndex(entity) % page_size];
+	}
+
+	void SparseIndex::set(Entity entity, u32 index) {
+		const u32 page = entityIndex(entity) / page_size;
+		if (page >= pages.size()) pages.resize(page + 1);
+		if (pages[page].empty()) pages[page].resize(page_size, invalid_index);
+		pages[page][entityIndex(entity) % page_size] = index;
+	}
+
+	void SparseIndex::erase(Entity entity) {
+		const u32 page = entityIndex(entity) / page_size;
+		if (page >= pages.size() || pages[page].empty()) return;
+		pages[page][entityIndex(entity) % page_size] = invalid_index;
+	}
+
+	u32 alignOffset(u32 offset, u32 alignment) {
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	Archetype::Archetype(const std::vector<ComponentInfo>& component_infos) :
+	infos(component_infos) {
+		std::sort(infos.begin(), infos.end(), [](const ComponentInfo& a, const ComponentInfo& b) { return a.type < b.type; });
+		u32 row_size = sizeof(Entity);
+		for (int i = 0; i < infos.size(); ++i) {
+			types.push_back(infos[i].type);
+			row_size += infos[i].size;
+		}
+		offsets.resize(infos.size());
+
+		//shrink the capacity until the padding between the arrays fits into the chunk as well
+		chunk_capacity = std::max(data_chunk_size / row_size, 1u);
+		for (;; --chunk_capacity) {
+			u32 offset = sizeof(Entity) * chunk_capacity;
+			for (int i = 0; i < infos.size(); ++i) {
+				offset = alignOffset(offset, infos[i].alignment);
+				offsets[i] = offset;
+				offset += infos[i].size * chunk_capacity;
+			}
+			chunk_bytes = offset;
+			if (offset <= data_chunk_size || chunk_capacity == 1) break;
+		}
+		chunk_bytes = std::max(chunk_bytes, (u32)data_chunk_size);
+	}
+
+	u32 Archetype::findType(typehash type) {
+		for (int i = 0; i < types.size(); ++i) {
+			if (types[i] == type) return i;
+		}
+		return invalid_index;
+	}
+
+	Entity* Archetype::getEntities(u32 chunk) {
+		return (Entity*)chunks[chunk].data;
+	}
+
+	u8* Archetype::getColumn(u32 chunk, u32 type_index) {
+		return chunks[chunk].data + offsets[type_index];
+	}
+
+	void Archetype::allocate(Entity entity, u32& chunk, u32& row, u32 tick) {
+		allocate(&entity, 1, chunk, row, tick);
+	}
+
+	u32 Archetype::allocate(const Entity* entities, u32 amount, u32& chunk, u32& row, u32 tick) {
+		if (chunks.empty() || chunks.back().count == chunk_capacity) {
+			ArchetypeChunk c;
+			c.data = new u8[chunk_bytes];
+			c.changed_ticks.resize(types.size());
+			chunks.push_back(c);
+		}
+		chunk = chunks.size() - 1;
+		row = chunks[chunk].count;
+		const u32 reserved = std::min(amount, chunk_capacity - row);
+		memcpy(getEntities(chunk) + row, entities, reserved * sizeof(Entity));
+		chunks[chunk].count += reserved;
+		std::fill(chunks[chunk].changed_ticks.begin(), chunks[chunk].changed_ticks.end(), tick);
+		chunks[chunk].added_tick = tick;
+		count += reserved;
+		return reserved;
+	}
+
+	Entity Archetype::remove(u32 chunk, u32 row, u32 tick, bool destroy) {
+		const u32 last_chunk = chunks.size() - 1;
+		const u32 last_row = chunks[last_chunk].count - 1;
+		Entity moved = 0;
+		for (int i = 0; i < infos.size(); ++i) {
+			u8* dst = getColumn(chunk, i) + row * infos[i].size;
+			if (destroy) infos[i].destroy(dst);
+			if (chunk != last_chunk || row != last_row) {
+				infos[i].move(dst, getColumn(last_chunk, i) + last_row * infos[i].size);
+			}
+		}
+		if (chunk != last_chunk || row != last_row) {
+			moved = getEntities(last_chunk)[last_row];
+			getEntities(chunk)[row] = moved;
+			std::fill(chunks[chunk].changed_ticks.begin(), chunks[chunk].changed_ticks.end(), tick);
+			//the moved entity may have been added after the other ones in its new chunk
+			chunks[chunk].added_tick = std::max(chunks[chunk].added_tick, chunks[last_chunk].added_tick);
+		}
+		--count;
+		if (--chunks[last_chunk].count == 0) {
+			delete[] chunks[last_chunk].data;
+			chunks.pop_back();
+		}
+		return moved;
+	}
+
+	void Archetype::reorder(const std::vector<u32>& order) {
+		std::vector<ArchetypeChunk> sorted(chunks.size());
+		for (u32 c = 0; c < chunks.size(); ++c) {
+			sorted[c].data = new u8[chunk_bytes];
+			sorted[c].count = chunks[c].count;
+			sorted[c].changed_ticks.resize(types.size(), 0);
+		}
+		for (u32 r = 0; r < order.size(); ++r) {
+			const u32 chunk = r / chunk_capacity, row = r % chunk_capacity;
+			const u32 old_chunk = order[r] / chunk_capacity, old_row = order[r] % chunk_capacity;
+			((Entity*)sorted[chunk].data)[row] = getEntities(old_chunk)[old_row];
+			for (u32 i = 0; i < infos.size(); ++i) {
+				u8* destination = sorted[chunk].data + offsets[i] + row * infos[i].size;
+				u8* source = getColumn(old_chunk, i) + old_row * infos[i].size;
+				if (infos[i].trivial) memcpy(destination, source, infos[i].size);
+				else infos[i].move(destination, source);
+				sorted[chunk].changed_ticks[i] = std::max(sorted[chunk].changed_ticks[i], chunks[old_chunk].changed_ticks[i]);
+			}
+			sorted[chunk].added_tick = std::max(sorted[chunk].added_tick, chunks[old_chunk].added_tick);
+		}
+		for (u32 c = 0; c < chunks.size(); ++c) delete[] chunks[c].data;
+		chunks.swap(sorted);
+	}
+
+	void Archetype::dispose() {
+		for (int c = 0; c < chunks.size(); ++c) {
+			for (int i = 0; i < infos.size(); ++i) {
+				u8* column = getColumn(c, i);
+				for (u32 r = 0; r < chunks[c].count; ++r) infos[i].destroy(column + r * infos[i].size);
+			}
+			delete[] chunks[c].data;
+		}
+		chunks.clear();
+		count = 0;
+	}
+
+	void TagSet::set(u32 index) {
+		if (index / 64 >= words.size()) words.resize(index / 64 + 1, 0);
+		words[index / 64] |= (u64)1 << (index % 64);
+	}
+
+	void TagSet::reset(u32 index) {
+		if (index / 64 < words.size()) words[index / 64] &= ~((u64)1 << (index % 64));
+	}
+
+	bool TagSet::test(u32 index) const {
+		return index / 64 < words.size() && (words[index / 64] >> (index % 64) & 1);
+	}
+
+	ComponentPool::ComponentPool(const ComponentInfo& info) :
+	info(info) {
+		slot_size = alignOffset(std::max(info.size, 1u), info.alignment);
+		slots_per_block = std::max(data_chunk_size / slot_size, 1u);
+	}
+
+	u8* ComponentPool::allocate() {
+		if (free_slots.empty()) {
+			u8* block = new u8[slots_per_block * slot_size];
+			blocks.push_back(block);
+			//push in reverse, so that the slots are handed out in ascending order
+			for (u32 i = slots_per_block; i > 0; --i) free_slots.push_back(block + (i - 1) * slot_size);
 		}
-		return e3;
+		u8* slot = free_slots.back();
+		free_slots.pop_back();
+		return slot;
+	}
+
+	void ComponentPool::release(u8* slot) {
+		info.destroy(slot);
+		free_slots.push_back(slot);
+	}
+
+	void ComponentPool::dispose() {
+		for (int i = 0; i < blocks.size(); ++i) delete[] blocks[i];
+		blocks.clear();
+		free_slots.clear();
 	}
 
 	ComponentArray::ComponentArray(typehash type) : 
 	data_type(type) {
 	}
 
-	void flo::ComponentArray::addComponent(Entity entity, u8* d) {
+	void flo::ComponentArray::addComponent(Entity entity, u8* d, u32 tick, bool is_owned) {
+		u32 index = findEntity(entity);
+		if (index != invalid_index) {
+			if (owned[index] && data[index] != d) pool->release(data[index]);
+			data[index] = d;
+			owned[index] = is_owned;
+			changed_ticks[index] = tick;
+			added_ticks[index] = tick;
+			return;
+		}
+		sparse.set(entity, map.size());
 		data.push_back(d);
 		map.push_back(entity);
+		changed_ticks.push_back(tick);
+		added_ticks.push_back(tick);
+		owned.push_back(is_owned);
 	}
 
 	void flo::ComponentArray::removeComponent(Entity entity) {
 		u32 index = findEntity(entity);
 		if (index == invalid_index) return;
-		map.erase(map.begin() + index);
-		data.erase(data.begin() + index);
+		if (owned[index]) pool->release(data[index]);
+		const u32 last = map.size() - 1;
+		if (index != last) {
+			map[index] = map[last];
+			data[index] = data[last];
+			changed_ticks[index] = changed_ticks[last];
+			added_ticks[index] = added_ticks[last];
+			owned[index] = owned[last];
+			sparse.set(map[index], index);
+		}
+		map.pop_back();
+		data.pop_back();
+		changed_ticks.pop_back();
+		added_ticks.pop_back();
+		owned.pop_back();
+		sparse.erase(entity);
 	}
 
 	u32 flo::ComponentArray::findEntity(Entity entity) {
-		if (map.size() < 1) return -1;
-		if (map[0] > entity || map[map.size() - 1] < entity) return invalid_index;
-		int half_s = to2Power(map.size());
-		int offset = 0;
-		for (; half_s >= 1; half_s /= 2) {
-			const uint in0 = offset;
-			const uint in1 = offset + half_s;
-			if (in1 < map.size()) {
-				if (map[in1] < entity) offset += half_s;
-				else if (map[in1] == entity) return offset + half_s;
-			}
-			if (map[in0] > entity) return invalid_index;
-			else if (map[in0] == entity) return offset;
-		}
-		return invalid_index;
+		const u32 index = sparse.get(entity);
+		if (index == invalid_index || map[index] != entity) return invalid_index;
+		return index;
 	}
 
 	u8* flo::ComponentArray::getData(Entity entity) {
@@ -53,43 +253,648 @@ namespace flo {
 		return data[index];
 	}
 
-	flo::EntityComponentSystem::EntityComponentSystem() {
+	void ComponentArray::markChanged(Entity entity, u32 tick) {
+		u32 index = findEntity(entity);
+		if (index != invalid_index) changed_ticks[index] = tick;
+	}
+
+	CommandBuffer::CommandBuffer(EntityComponentSystem& parent_ecs, u32 index) :
+	parent_ecs(&parent_ecs), index(index) {
+	}
+
+	Entity CommandBuffer::registerEntity() {
+		Command command = { parent_ecs->reserveEntity(), command_create, 0, nullptr, index, (u32)commands.size() };
+		commands.push_back(command);
+		return command.entity;
+	}
+
+	void CommandBuffer::addComponent(Entity entity, typehash type, void* data) {
+		Command command = { entity, command_add, type, (u8*)data, index, (u32)commands.size() };
+		auto info = parent_ecs->componentInfos.find(type);
+		if (info != parent_ecs->componentInfos.end()) {
+			command.data = allocate(info->second.size, info->second.alignment);
+			info->second.copy(command.data, (const u8*)data);
+		}
+		commands.push_back(command);
+	}
+
+	void CommandBuffer::removeEntity(Entity entity) {
+		Command command = { entity, command_destroy, 0, nullptr, index, (u32)commands.size() };
+		commands.push_back(command);
+	}
+
+	u8* CommandBuffer::allocate(u32 size, u32 alignment) {
+		u32 offset = alignOffset(block_offset, alignment);
+		if (blocks.empty() || offset + size > data_chunk_size) {
+			//components that are larger than a block get a block of their own
+			blocks.push_back(new u8[std::max(size, (u32)data_chunk_size)]);
+			offset = 0;
+		}
+		block_offset = offset + size;
+		return blocks.back() + offset;
+	}
+
+	void CommandBuffer::clear() {
+		for (int i = 0; i < commands.size(); ++i) {
+			if (commands[i].type != command_add) continue;
+			auto info = parent_ecs->componentInfos.find(commands[i].component);
+			if (info != parent_ecs->componentInfos.end()) info->second.destroy(commands[i].data);
+		}
+		commands.clear();
+
+		//keep one block around, as the buffer will most likely be used again
+		for (int i = 1; i < blocks.size(); ++i) delete[] blocks[i];
+		if (blocks.size() > 1) blocks.resize(1);
+		block_offset = 0;
+	}
+
+	void CommandBuffer::dispose() {
+		clear();
+		for (int i = 0; i < blocks.size(); ++i) delete[] blocks[i];
+		blocks.clear();
+	}
+
+	void Prefab::setComponent(const ComponentInfo& info, const u8* value) {
+		auto iter = std::lower_bound(infos.begin(), infos.end(), info.type, [](const ComponentInfo& a, typehash type) { return a.type < type; });
+		const u32 index = iter - infos.begin();
+		if (iter != infos.end() && iter->type == info.type) {
+			infos[index].destroy(values[index]);
+			infos[index].copy(values[index], value);
+			return;
+		}
+		infos.insert(iter, info);
+		values.insert(values.begin() + index, new u8[std::max(info.size, 1u)]);
+		info.copy(values[index], value);
+	}
+
+	u8* Prefab::getComponent(typehash type) {
+		for (int i = 0; i < infos.size(); ++i) {
+			if (infos[i].type == type) return values[i];
+		}
+		return nullptr;
+	}
+
+	void Prefab::dispose() {
+		for (int i = 0; i < infos.size(); ++i) {
+			infos[i].destroy(values[i]);
+			delete[] values[i];
+		}
+		infos.clear();
+		values.clear();
+	}
+
+	std::atomic<u32> next_command_buffer_generation(1);
+
+	struct CachedCommandBuffer {
+		u32 generation = 0;
+		CommandBuffer* buffer = nullptr;
+	};
+
+	thread_local CachedCommandBuffer cached_command_buffer;
+
+	flo::EntityComponentSystem::EntityComponentSystem() :
+	change_tick(1), command_buffer_generation(next_command_buffer_generation++) {
+		//slot 0 is never used, so that no valid entity hash is 0
+		generations.push_back(0);
 	}
 
 	void flo::EntityComponentSystem::registerComponent(typehash type) {
+		if (componentInfos.count(type)) return;
 		componentArrays.insert(std::make_pair(type, ComponentArray(type)));
 	}
 
+	void EntityComponentSystem::registerComponent(const ComponentInfo& info, ComponentStorage storage) {
+		if (componentInfos.count(info.type) || componentArrays.count(info.type)) return;
+		if (storage == storage_archetype) componentInfos.insert(std::make_pair(info.type, info));
+		else registerComponent(info.type);
+	}
+
+	void EntityComponentSystem::updateLOD(glm::vec2 focus, float distance) {
+		const float limit = distance * distance;
+		view<const TransformComponent>().each([this, focus, limit](Entity entity, const TransformComponent& transform) {
+			const glm::vec2 offset = transform.pos - focus;
+			const float squared = offset.x * offset.x + offset.y * offset.y;
+			u8 level = 0;
+			//every level doubles the distance, which quadruples the squared distance
+			for (float bound = limit; squared >= bound && level < lod_level_count - 1; bound *= 4) ++level;
+			assignLOD(entityIndex(entity), level);
+		});
+	}
+
+	void EntityComponentSystem::setLOD(Entity entity, u32 level) {
+		if (!isAlive(entity)) return;
+		assignLOD(entityIndex(entity), std::min(level, lod_level_count - 1));
+	}
+
+	void EntityComponentSystem::assignLOD(u32 index, u32 level, bool reset) {
+		if (lod_levels.size() <= index) {
+			lod_levels.resize(index + 1, 0);
+			lod_changed_frames.resize(index + 1, 0);
+			lod_due_times.resize(index + 1, 0);
+		}
+		if (!reset && lod_levels[index] == level) return;
+		lod_due_times[index] = reset ? lod_time : getDueTime(index, lod_frame);
+		lod_changed_frames[index] = lod_frame;
+		lod_levels[index] = level;
+	}
+
+	void EntityComponentSystem::registerTag(typehash type) {
+		tag_sets[type];
+	}
+
+	void EntityComponentSystem::addTag(Entity entity, typehash type) {
+		auto tags = tag_sets.find(type);
+		if (tags != tag_sets.end() && isAlive(entity)) tags->second.set(entityIndex(entity));
+	}
+
+	void EntityComponentSystem::removeTag(Entity entity, typehash type) {
+		auto tags = tag_sets.find(type);
+		if (tags != tag_sets.end() && isAlive(entity)) tags->second.reset(entityIndex(entity));
+	}
+
+	bool EntityComponentSystem::hasTag(Entity entity, typehash type) {
+		auto tags = tag_sets.find(type);
+		return tags != tag_sets.end() && isAlive(entity) && tags->second.test(entityIndex(entity));
+	}
+
+	bool EntityComponentSystem::buildTagMask(const std::vector<typehash>& with, const std::vector<typehash>& without, std::vector<u64>& mask) {
+		u32 word_count;
+		{
+			//views are built inside systems running in parallel, while reserveEntity() may grow the generations
+			std::lock_guard<std::mutex> lock(entity_mutex);
+			word_count = (generations.size() + 63) / 64;
+		}
+		std::vector<const TagSet*> required;
+		for (int i = 0; i < with.size(); ++i) {
+			auto tags = tag_sets.find(with[i]);
+			if (tags == tag_sets.end()) return false;
+			required.push_back(&tags->second);
+			word_count = std::min(word_count, (u32)tags->second.words.size());
+		}
+		mask.assign(word_count, ~(u64)0);
+		for (int i = 0; i < required.size(); ++i) {
+			const u64* words = required[i]->words.data();
+			for (u32 w = 0; w < word_count; ++w) mask[w] &= words[w];
+		}
+		for (int i = 0; i < without.size(); ++i) {
+			auto tags = tag_sets.find(without[i]);
+			if (tags == tag_sets.end()) continue;
+			const u64* words = tags->second.words.data();
+			const u32 count = std::min(word_count, (u32)tags->second.words.size());
+			for (u32 w = 0; w < count; ++w) mask[w] &= ~words[w];
+		}
+		return true;
+	}
+
+	u64 spreadBits(u32 value) {
+		u64 x = value;
+		x = (x | x << 16) & 0x0000FFFF0000FFFFull;
+		x = (x | x << 8) & 0x00FF00FF00FF00FFull;
+		x = (x | x << 4) & 0x0F0F0F0F0F0F0F0Full;
+		x = (x | x << 2) & 0x3333333333333333ull;
+		x = (x | x << 1) & 0x5555555555555555ull;
+		return x;
+	}
+
+	u64 mortonCode(glm::vec2 pos, float cell_size) {
+		const float limit = 2147483520.f;
+		const i32 x = (i32)std::max(-limit, std::min(limit, std::floor(pos.x / cell_size)));
+		const i32 y = (i32)std::max(-limit, std::min(limit, std::floor(pos.y / cell_size)));
+		//flipping the sign bit keeps negative coordinates in front of positive ones
+		return spreadBits((u32)x ^ 0x80000000u) | spreadBits((u32)y ^ 0x80000000u) << 1;
+	}
+
+	bool System::conflictsWith(const System& other) const {
+		if (read_access.empty() && write_access.empty()) return true;
+		if (other.read_access.empty() && other.write_access.empty()) return true;
+		for (int i = 0; i < write_access.size(); ++i) {
+			const typehash type = write_access[i];
+			if (std::find(other.read_access.begin(), other.read_access.end(), type) != other.read_access.end()) return true;
+			if (std::find(other.write_access.begin(), other.write_access.end(), type) != other.write_access.end()) return true;
+		}
+		for (int i = 0; i < other.write_access.size(); ++i) {
+			if (std::find(read_access.begin(), read_access.end(), other.write_access[i]) != read_access.end()) return true;
+		}
+		return false;
+	}
+
+	void System::entitiesAdded(const Entity* entities, u32 count) {
+		for (u32 i = 0; i < count; ++i) entityAdded(entities[i]);
+	}
+
+	void System::entitiesDestroyed(const Entity* entities, u32 count) {
+		for (u32 i = 0; i < count; ++i) entityDestroyed(entities[i]);
+	}
+
 	void EntityComponentSystem::registerSystem(System* system) {
 		systems.push_back(system);
 		system->parent_ecs = this;
 		system->onRegistered();
+
+		const u32 index = systems.size() - 1;
+		system_dependents.push_back(std::vector<u32>());
+		system_dependencies.push_back(0);
+		for (u32 i = 0; i < index; ++i) {
+			if (!systems[i]->conflictsWith(*system)) continue;
+			system_dependents[i].push_back(index);
+			++system_dependencies[index];
+		}
+	}
+
+	void EntityComponentSystem::runSystems(float dt) {
+		notifySystems();
+
+		++lod_frame;
+		lod_time += dt;
+		lod_frame_times[lod_frame & 15] = lod_time;
+
+		if (!thread_pool) {
+			for (int i = 0; i < systems.size(); ++i) {
+				const u32 tick = ++change_tick;
+				systems[i]->update(dt);
+				systems[i]->last_run_tick = tick;
+			}
+			finishSystems();
+			return;
+		}
+
+		std::vector<std::atomic<u32>> remaining(systems.size());
+		std::atomic<u32> unfinished(systems.size());
+		std::function<void(u32)> launch = [&](u32 index) {
+			thread_pool->submit([&, index]() {
+				//the tick is taken when the system starts, so it is greater than that of every system it waited for
+				const u32 tick = ++change_tick;
+				systems[index]->update(dt);
+				systems[index]->last_run_tick = tick;
+				for (int i = 0; i < system_dependents[index].size(); ++i) {
+					const u32 dependent = system_dependents[index][i];
+					if (--remaining[dependent] == 0) launch(dependent);
+				}
+				--unfinished;
+			});
+		};
+		for (int i = 0; i < systems.size(); ++i) remaining[i] = system_dependencies[i];
+		for (int i = 0; i < systems.size(); ++i) {
+			if (system_dependencies[i] == 0) launch(i);
+		}
+		thread_pool->wait(unfinished);
+		finishSystems();
+	}
+
+	void EntityComponentSystem::finishSystems() {
+		//everything that happens until the next update has to count as changed for all systems
+		++change_tick;
+		playbackCommands();
+		notifySystems();
+
+		u32 oldest_tick = change_tick;
+		for (int i = 0; i < systems.size(); ++i) oldest_tick = std::min(oldest_tick, systems[i]->last_run_tick);
+		removed_entities.erase(std::remove_if(removed_entities.begin(), removed_entities.end(), [oldest_tick](const std::pair<Entity, u32>& removed) {
+			return removed.second <= oldest_tick;
+		}), removed_entities.end());
+	}
+
+	void EntityComponentSystem::notifySystems() {
+		if (!pending_added.empty() && !pending_destroyed.empty()) {
+			//entities that did not live until the notification are of no interest to the systems
+			std::vector<Entity> short_lived(pending_added.begin(), pending_added.end());
+			std::sort(short_lived.begin(), short_lived.end());
+			auto is_short_lived = [&short_lived](Entity entity) { return std::binary_search(short_lived.begin(), short_lived.end(), entity); };
+			pending_destroyed.erase(std::remove_if(pending_destroyed.begin(), pending_destroyed.end(), is_short_lived), pending_destroyed.end());
+			pending_added.erase(std::remove_if(pending_added.begin(), pending_added.end(), [this](Entity entity) { return !isAlive(entity); }), pending_added.end());
+		}
+		//the callbacks may create or remove entities themselves, which are then announced on the next call
+		std::vector<Entity> added, destroyed;
+		added.swap(pending_added);
+		destroyed.swap(pending_destroyed);
+		if (!added.empty()) {
+			for (int i = 0; i < systems.size(); ++i) systems[i]->entitiesAdded(added.data(), added.size());
+		}
+		if (!destroyed.empty()) {
+			for (int i = 0; i < systems.size(); ++i) systems[i]->entitiesDestroyed(destroyed.data(), destroyed.size());
+		}
 	}
 
 	Entity EntityComponentSystem::registerEntity() {
-		++current_entity;
+		releaseStagedComponents();
+		current_entity = reserveEntity();
+		creating_entity = true;
 		return current_entity;
 	}
 
+	void EntityComponentSystem::releaseStagedComponents() {
+		for (int i = 0; i < owned_staged_components.size(); ++i) {
+			component_pools[owned_staged_components[i].first].release(owned_staged_components[i].second);
+		}
+		owned_staged_components.clear();
+		staged_components.clear();
+	}
+
+	void EntityComponentSystem::unstageComponent(typehash type) {
+		for (int i = 0; i < staged_components.size(); ++i) {
+			if (staged_components[i].first != type) continue;
+			staged_components.erase(staged_components.begin() + i);
+			break;
+		}
+		for (int i = 0; i < owned_staged_components.size(); ++i) {
+			if (owned_staged_components[i].first != type) continue;
+			component_pools[type].release(owned_staged_components[i].second);
+			owned_staged_components.erase(owned_staged_components.begin() + i);
+			break;
+		}
+	}
+
+	Entity EntityComponentSystem::reserveEntity() {
+		std::lock_guard<std::mutex> lock(entity_mutex);
+		if (free_slots.empty()) {
+			generations.push_back(0);
+			return makeEntity(generations.size() - 1, 0);
+		}
+		const u32 index = free_slots.back();
+		free_slots.pop_back();
+		return makeEntity(index, generations[index]);
+	}
+
+	void EntityComponentSystem::reserveEntities(Entity* output, u32 count) {
+		std::lock_guard<std::mutex> lock(entity_mutex);
+		u32 i = 0;
+		for (; i < count && !free_slots.empty(); ++i) {
+			output[i] = makeEntity(free_slots.back(), generations[free_slots.back()]);
+			free_slots.pop_back();
+		}
+		const u32 first = generations.size();
+		generations.resize(first + count - i, 0);
+		for (u32 index = first; i < count; ++i, ++index) output[i] = makeEntity(index, 0);
+	}
+
+	void EntityComponentSystem::instantiate(const Prefab& prefab, u32 count, std::vector<Entity>& output) {
+		if (count == 0) return;
+		const u32 first = output.size();
+		output.resize(first + count);
+		Entity* entities = output.data() + first;
+		reserveEntities(entities, count);
+		if (locations.size() < generations.size()) locations.resize(generations.size());
+
+		std::vector<typehash> types;
+		std::vector<const u8*> archetype_values;
+		for (int i = 0; i < prefab.infos.size(); ++i) {
+			const typehash type = prefab.infos[i].type;
+			if (componentInfos.count(type)) {
+				types.push_back(type);
+				archetype_values.push_back(prefab.values[i]);
+				continue;
+			}
+			ComponentArray* arr = getComponentArray(type);
+			if (!arr) continue;
+
+			auto pool = component_pools.find(type);
+			if (pool == component_pools.end()) pool = component_pools.insert(std::make_pair(type, ComponentPool(prefab.infos[i]))).first;
+			arr->pool = &pool->second;
+			for (u32 e = 0; e < count; ++e) {
+				u8* component = pool->second.allocate();
+				prefab.infos[i].copy(component, prefab.values[i]);
+				arr->addComponent(entities[e], component, change_tick, true);
+			}
+		}
+
+		if (!types.empty()) {
+			Archetype* archetype = getArchetype(types);
+			for (u32 placed = 0; placed < count;) {
+				u32 chunk, row;
+				const u32 amount = archetype->allocate(entities + placed, count - placed, chunk, row, change_tick);
+				for (u32 i = 0; i < types.size(); ++i) {
+					const ComponentInfo& info = archetype->infos[i];
+					u8* column = archetype->getColumn(chunk, i) + row * info.size;
+					if (!info.trivial) {
+						for (u32 r = 0; r < amount; ++r) info.copy(column + r * info.size, archetype_values[i]);
+						continue;
+					}
+					//copy the first component, then keep doubling the filled range
+					memcpy(column, archetype_values[i], info.size);
+					for (u32 filled = 1; filled < amount; filled *= 2) {
+						memcpy(column + filled * info.size, column, std::min(filled, amount - filled) * info.size);
+					}
+				}
+				for (u32 r = 0; r < amount; ++r) {
+					EntityLocation& location = locations[entityIndex(entities[placed + r])];
+					location.archetype = archetype;
+					location.chunk = chunk;
+					location.row = row + r;
+				}
+				placed += amount;
+			}
+		}
+		pending_added.insert(pending_added.end(), entities, entities + count);
+	}
+
+	bool EntityComponentSystem::isAlive(Entity entity) {
+		const u32 index = entityIndex(entity);
+		//reserveEntity() may grow the generations from other threads at any time
+		std::lock_guard<std::mutex> lock(entity_mutex);
+		return index != 0 && index < generations.size() && generations[index] == entityGeneration(entity);
+	}
+
+	void EntityComponentSystem::addComponent(Entity entity, typehash type, void* data) {
+		if (creating_entity && entity == current_entity) {
+			addComponent(type, data);
+			return;
+		}
+		auto info = componentInfos.find(type);
+		if (info == componentInfos.end()) {
+			ComponentArray* arr = getComponentArray(type);
+			if (arr && isAlive(entity)) arr->addComponent(entity, (u8*)data, change_tick);
+			return;
+		}
+		u8* component = allocateComponent(entity, info->second);
+		if (component) info->second.copy(component, (const u8*)data);
+	}
+
+	u8* EntityComponentSystem::allocateComponent(Entity entity, const ComponentInfo& component_type) {
+		const typehash type = component_type.type;
+		ComponentArray* arr = getComponentArray(type);
+		auto info = componentInfos.find(type);
+		if ((!arr && info == componentInfos.end()) || !isAlive(entity)) return nullptr;
+
+		if (!arr && creating_entity && entity == current_entity) {
+			//emplacing a staged type again replaces the staged component, as it would for a finalized entity
+			for (int i = 0; i < owned_staged_components.size(); ++i) {
+				if (owned_staged_components[i].first != type) continue;
+				info->second.destroy(owned_staged_components[i].second);
+				return owned_staged_components[i].second;
+			}
+		}
+
+		if (arr || (creating_entity && entity == current_entity)) {
+			auto pool = component_pools.find(type);
+			if (pool == component_pools.end()) pool = component_pools.insert(std::make_pair(type, ComponentPool(component_type))).first;
+			u8* component = pool->second.allocate();
+			if (arr) {
+				arr->pool = &pool->second;
+				arr->addComponent(entity, component, change_tick, true);
+			}
+			else {
+				//archetype components of an entity that is being created are constructed in the pool and copied on finalization
+				unstageComponent(type);
+				staged_components.push_back(std::make_pair(type, (const u8*)component));
+				owned_staged_components.push_back(std::make_pair(type, component));
+			}
+			return component;
+		}
+
+		const u32 index = entityIndex(entity);
+		if (locations.size() <= index) locations.resize(index + 1);
+		EntityLocation& old_location = locations[index];
+		std::vector<typehash> types;
+		if (old_location.archetype) {
+			u32 existing = old_location.archetype->findType(type);
+			if (existing != invalid_index) {
+				//replace the component in place
+				u8* component = old_location.archetype->getColumn(old_location.chunk, existing) + old_location.row * info->second.size;
+				info->second.destroy(component);
+				old_location.archetype->chunks[old_location.chunk].changed_ticks[existing] = change_tick;
+				return component;
+			}
+			types = old_location.archetype->types;
+		}
+		types.insert(std::upper_bound(types.begin(), types.end(), type), type);
+
+		Archetype* archetype = getArchetype(types);
+		EntityLocation location;
+		location.archetype = archetype;
+		archetype->allocate(entity, location.chunk, location.row, change_tick);
+		u8* component = nullptr;
+		for (u32 i = 0; i < archetype->types.size(); ++i) {
+			const ComponentInfo& component_info = archetype->infos[i];
+			u8* destination = archetype->getColumn(location.chunk, i) + location.row * component_info.size;
+			if (archetype->types[i] == type) {
+				component = destination;
+				continue;
+			}
+			const u32 old_index = old_location.archetype->findType(archetype->types[i]);
+			component_info.move(destination, old_location.archetype->getColumn(old_location.chunk, old_index) + old_location.row * component_info.size);
+		}
+		if (old_location.archetype) {
+			Entity moved = old_location.archetype->remove(old_location.chunk, old_location.row, change_tick, false);
+			if (moved) locations[entityIndex(moved)] = old_location;
+		}
+		locations[index] = location;
+		return component;
+	}
+
+	CommandBuffer& EntityComponentSystem::getCommandBuffer() {
+		if (cached_command_buffer.generation == command_buffer_generation) return *cached_command_buffer.buffer;
+		std::lock_guard<std::mutex> lock(command_buffer_mutex);
+		CommandBuffer*& buffer = command_buffers[std::this_thread::get_id()];
+		if (!buffer) buffer = new CommandBuffer(*this, command_buffers.size() - 1);
+		cached_command_buffer.generation = command_buffer_generation;
+		cached_command_buffer.buffer = buffer;
+		return *buffer;
+	}
+
+	void EntityComponentSystem::playbackCommands() {
+		std::vector<CommandBuffer::Command> commands;
+		for (auto iter = command_buffers.begin(); iter != command_buffers.end(); ++iter) {
+			commands.insert(commands.end(), iter->second->commands.begin(), iter->second->commands.end());
+		}
+		if (commands.empty()) return;
+
+		//group the commands by entity; creation comes first, destruction last, and the rest keeps the recording order
+		std::sort(commands.begin(), commands.end(), [](const CommandBuffer::Command& a, const CommandBuffer::Command& b) {
+			if (a.entity != b.entity) return a.entity < b.entity;
+			if (a.type != b.type) return a.type < b.type;
+			if (a.buffer != b.buffer) return a.buffer < b.buffer;
+			return a.sequence < b.sequence;
+		});
+		locations.reserve(generations.size());
+
+		for (int begin = 0, end = 0; begin < commands.size(); begin = end) {
+			const Entity entity = commands[begin].entity;
+			while (end < commands.size() && commands[end].entity == entity) ++end;
+			const bool created = commands[begin].type == CommandBuffer::command_create;
+			const bool destroyed = commands[end - 1].type == CommandBuffer::command_destroy;
+			if (created && destroyed) {
+				//the entity never existed outside of the buffers, so only its slot has to be recycled
+				std::lock_guard<std::mutex> lock(entity_mutex);
+				++generations[entityIndex(entity)];
+				free_slots.push_back(entityIndex(entity));
+				continue;
+			}
+
+			if (created) {
+				releaseStagedComponents();
+				current_entity = entity;
+				creating_entity = true;
+				for (int i = begin; i < end; ++i) {
+					if (commands[i].type == CommandBuffer::command_add) addComponent(commands[i].component, commands[i].data);
+				}
+				finalizeEntity();
+			}
+			else {
+				for (int i = begin; i < end; ++i) {
+					if (commands[i].type == CommandBuffer::command_add) addComponent(entity, commands[i].component, commands[i].data);
+				}
+			}
+			if (destroyed) removeEntity(entity);
+		}
+
+		for (auto iter = command_buffers.begin(); iter != command_buffers.end(); ++iter) iter->second->clear();
+	}
+
 	void EntityComponentSystem::removeEntity(Entity entity) {
+		if (!isAlive(entity)) return;
+		const u32 index = entityIndex(entity);
+		if (index < locations.size() && locations[index].archetype) {
+			EntityLocation& location = locations[index];
+			Entity moved = location.archetype->remove(location.chunk, location.row, change_tick);
+			if (moved) locations[entityIndex(moved)] = location;
+			location = EntityLocation();
+		}
 		for (auto iter = componentArrays.begin(); iter != componentArrays.end(); ++iter) {
 			iter->second.removeComponent(entity);
 		}
-		for (int i = 0; i < systems.size(); ++i) {
-			systems[i]->entityDestroyed(entity);
-		}
+		for (auto iter = tag_sets.begin(); iter != tag_sets.end(); ++iter) iter->second.reset(index);
+		//the next entity in the slot starts counting its time from now
+		if (index < lod_levels.size()) assignLOD(index, 0, true);
+		pending_destroyed.push_back(entity);
+		removed_entities.push_back(std::make_pair(entity, (u32)change_tick));
+
+		std::lock_guard<std::mutex> lock(entity_mutex);
+		++generations[index];
+		free_slots.push_back(index);
 	}
 
 	void flo::EntityComponentSystem::addComponent(typehash type, void* data) {
+		if (componentInfos.count(type)) {
+			unstageComponent(type);
+			staged_components.push_back(std::make_pair(type, (const u8*)data));
+			return;
+		}
 		ComponentArray* arr = getComponentArray(type);
 		if (!arr) return;
-		arr->addComponent(current_entity, (u8*)data);
+		arr->addComponent(current_entity, (u8*)data, change_tick);
 	}
 
 	void EntityComponentSystem::finalizeEntity() {
-		for (int i = 0; i < systems.size(); ++i) {
-			systems[i]->entityAdded(current_entity);
+		if (!staged_components.empty()) {
+			std::sort(staged_components.begin(), staged_components.end());
+			std::vector<typehash> types;
+			for (int i = 0; i < staged_components.size(); ++i) types.push_back(staged_components[i].first);
+
+			Archetype* archetype = getArchetype(types);
+			EntityLocation location;
+			location.archetype = archetype;
+			archetype->allocate(current_entity, location.chunk, location.row, change_tick);
+			for (int i = 0; i < staged_components.size(); ++i) {
+				const ComponentInfo& info = archetype->infos[i];
+				info.copy(archetype->getColumn(location.chunk, i) + location.row * info.size, staged_components[i].second);
+			}
+			const u32 index = entityIndex(current_entity);
+			if (locations.size() <= index) locations.resize(index + 1);
+			locations[index] = location;
+			releaseStagedComponents();
 		}
+		creating_entity = false;
+		pending_added.push_back(current_entity);
 	}
 
 	ComponentArray* flo::EntityComponentSystem::getComponentArray(typehash type) {
@@ -100,14 +905,155 @@ namespace flo {
 
 	u8* flo::EntityComponentSystem::getComponent(typehash component_type, Entity entity) {
 		ComponentArray* arr = getComponentArray(component_type);
-		if (!arr) return nullptr;
+		if (!arr) return getArchetypeComponent(component_type, entity);
 		return arr->getData(entity);
 	}
 
+	EntityLocation* EntityComponentSystem::getLocation(Entity entity) {
+		const u32 index = entityIndex(entity);
+		if (index >= locations.size() || !locations[index].archetype) return nullptr;
+		EntityLocation& location = locations[index];
+		if (location.archetype->getEntities(location.chunk)[location.row] != entity) return nullptr;
+		return &location;
+	}
+
+	u8* EntityComponentSystem::getArchetypeComponent(typehash component_type, Entity entity) {
+		EntityLocation* location = getLocation(entity);
+		if (!location) return nullptr;
+		u32 type_index = location->archetype->findType(component_type);
+		if (type_index == invalid_index) return nullptr;
+		return location->archetype->getColumn(location->chunk, type_index) + location->row * location->archetype->infos[type_index].size;
+	}
+
+	void EntityComponentSystem::markChanged(typehash component_type, Entity entity) {
+		ComponentArray* arr = getComponentArray(component_type);
+		if (arr) {
+			arr->markChanged(entity, change_tick);
+			return;
+		}
+		EntityLocation* location = getLocation(entity);
+		if (!location) return;
+		u32 type_index = location->archetype->findType(component_type);
+		if (type_index != invalid_index) location->archetype->chunks[location->chunk].changed_ticks[type_index] = change_tick;
+	}
+
+	u32 EntityComponentSystem::getChangedTick(typehash component_type, Entity entity) {
+		ComponentArray* arr = getComponentArray(component_type);
+		if (arr) {
+			const u32 index = arr->findEntity(entity);
+			return index == invalid_index ? 0 : arr->changed_ticks[index];
+		}
+		EntityLocation* location = getLocation(entity);
+		if (!location) return 0;
+		u32 type_index = location->archetype->findType(component_type);
+		return type_index == invalid_index ? 0 : location->archetype->chunks[location->chunk].changed_ticks[type_index];
+	}
+
+	void EntityComponentSystem::getRemovedSince(u32 tick, std::vector<Entity>& output) {
+		for (int i = 0; i < removed_entities.size(); ++i) {
+			if (removed_entities[i].second > tick) output.push_back(removed_entities[i].first);
+		}
+	}
+
 	u8* EntityComponentSystem::getComponentFromAdded(typehash type) {
-		ComponentArray* arr = getComponentArray(type);
-		if (!arr) return nullptr;
-		return arr->getData(current_entity);
+		return getComponent(type, current_entity);
+	}
+
+	Archetype* EntityComponentSystem::getArchetype(const std::vector<typehash>& types) {
+		auto iter = archetypes.find(types);
+		if (iter != archetypes.end()) return iter->second;
+
+		std::vector<ComponentInfo> infos;
+		for (int i = 0; i < types.size(); ++i) infos.push_back(componentInfos[types[i]]);
+		Archetype* archetype = new Archetype(infos);
+		archetypes.insert(std::make_pair(types, archetype));
+		return archetype;
+	}
+
+	void EntityComponentSystem::sortSpatially(float cell_size) {
+		const typehash transform_type = uniqueCode<TransformComponent>();
+		ComponentArray* transforms = getComponentArray(transform_type);
+		std::vector<std::pair<u64, u32>> keys;
+		std::vector<u32> order;
+		for (auto iter = archetypes.begin(); iter != archetypes.end(); ++iter) {
+			Archetype* archetype = iter->second;
+			const u32 column = archetype->findType(transform_type);
+			if (archetype->count < 2 || (column == invalid_index && !transforms)) continue;
+
+			keys.clear();
+			for (u32 c = 0; c < archetype->chunks.size(); ++c) {
+				const Entity* entities = archetype->getEntities(c);
+				for (u32 r = 0; r < archetype->chunks[c].count; ++r) {
+					const TransformComponent* transform = column != invalid_index ?
+						(TransformComponent*)archetype->getColumn(c, column) + r : (TransformComponent*)transforms->getData(entities[r]);
+					//entities without a transform are moved to the end
+					const u64 key = transform ? mortonCode(transform->pos, cell_size) : ~(u64)0;
+					keys.push_back(std::make_pair(key, c * archetype->chunk_capacity + r));
+				}
+			}
+			if (std::is_sorted(keys.begin(), keys.end())) continue;
+			std::sort(keys.begin(), keys.end());
+
+			order.resize(keys.size());
+			for (u32 i = 0; i < keys.size(); ++i) order[i] = keys[i].second;
+			archetype->reorder(order);
+			for (u32 c = 0; c < archetype->chunks.size(); ++c) {
+				const Entity* entities = archetype->getEntities(c);
+				for (u32 r = 0; r < archetype->chunks[c].count; ++r) {
+					EntityLocation& location = locations[entityIndex(entities[r])];
+					location.chunk = c;
+					location.row = r;
+				}
+			}
+		}
+	}
+
+	void EntityComponentSystem::forEachChunk(const std::vector<typehash>& types, const std::function<void(Entity* entities, u8** columns, u32 count)>& callback) {
+		std::vector<u32> type_indices(types.size());
+		std::vector<u8*> columns(types.size());
+		for (auto iter = archetypes.begin(); iter != archetypes.end(); ++iter) {
+			Archetype* archetype = iter->second;
+			bool matches = archetype->count > 0;
+			for (int i = 0; i < types.size() && matches; ++i) {
+				type_indices[i] = archetype->findType(types[i]);
+				matches = type_indices[i] != invalid_index;
+			}
+			if (!matches) continue;
+
+			for (u32 c = 0; c < archetype->chunks.size(); ++c) {
+				for (int i = 0; i < types.size(); ++i) columns[i] = archetype->getColumn(c, type_indices[i]);
+				callback(archetype->getEntities(c), columns.data(), archetype->chunks[c].count);
+			}
+		}
+	}
+
+	void EntityComponentSystem::dispose() {
+		for (auto iter = archetypes.begin(); iter != archetypes.end(); ++iter) {
+			iter->second->dispose();
+			delete iter->second;
+		}
+		archetypes.clear();
+		locations.clear();
+
+		for (auto iter = command_buffers.begin(); iter != command_buffers.end(); ++iter) {
+			iter->second->dispose();
+			delete iter->second;
+		}
+		command_buffers.clear();
+		//threads still caching one of the deleted buffers will look theirs up again
+		command_buffer_generation = next_command_buffer_generation++;
+
+		releaseStagedComponents();
+		creating_entity = false;
+		for (auto iter = componentArrays.begin(); iter != componentArrays.end(); ++iter) {
+			ComponentArray& arr = iter->second;
+			for (int i = 0; i < arr.data.size(); ++i) {
+				if (arr.owned[i]) arr.pool->release(arr.data[i]);
+			}
+			arr = ComponentArray(arr.data_type);
+		}
+		for (auto iter = component_pools.begin(); iter != component_pools.end(); ++iter) iter->second.dispose();
+		component_pools.clear();
 	}
 
 	ComponentBundleArray::ComponentBundleArray(const std::vector<typehash>& types, EntityComponentSystem& parent_ecs) :
@@ -117,20 +1063,35 @@ namespace flo {
 
 	void ComponentBundleArray::onAdded(Entity entity) {
 		for (int i = 0; i < types.size(); ++i) {
-			u8* comp = parent_ecs->getComponentFromAdded(types[i]);
+			u8* comp = parent_ecs->getComponent(types[i], entity);
 			if (!comp) break;
 			data.push_back(comp);
-			if (i == types.size() - 1) map.push_back(entity);
+			if (i == types.size() - 1) {
+				sparse.set(entity, map.size());
+				map.push_back(entity);
+			}
 		}
 		data.resize(map.size() * types.size());
 	}
 
+	void ComponentBundleArray::onAdded(const Entity* entities, u32 count) {
+		data.reserve((map.size() + count) * types.size());
+		map.reserve(map.size() + count);
+		for (u32 i = 0; i < count; ++i) onAdded(entities[i]);
+	}
+
 	void ComponentBundleArray::onRemoved(Entity entity) {
-		for (int i = 0; i < map.size(); ++i) {
-			if (map[i] == entity) {
-				data.erase(data.begin() + i * types.size(), data.begin() + (i + 1) * types.size());
-			}
+		const u32 index = sparse.get(entity);
+		if (index == invalid_index || map[index] != entity) return;
+		const u32 last = map.size() - 1;
+		if (index != last) {
+			std::copy(data.begin() + last * types.size(), data.end(), data.begin() + index * types.size());
+			map[index] = map[last];
+			sparse.set(map[index], index);
 		}
+		map.pop_back();
+		data.resize(map.size() * types.size());
+		sparse.erase(entity);
 	}
 
 	u8* ComponentBundleArray::getComponent(int type_index, int index) {
@@ -149,4 +1110,60 @@ namespace flo {
 	glm::mat3 TransformComponent::getSpriteMatrix() {
 		return flo::generate_tsrt_matrix(glm::vec2(-0.5), size * 2.f, glm::vec2(glm::cos(angle), glm::sin(angle)), pos);
 	}
+
+	void writeSpriteMatrix(float* matrix, float pos_x, float pos_y, float size_x, float size_y, float sin, float cos) {
+		//this is generate_tsrt_matrix() with an initial offset of -0.5 and a scale of 2 * size, written out
+		matrix[0] = 2 * size_x * cos;
+		matrix[1] = 2 * size_x * sin;
+		matrix[2] = 0;
+		matrix[3] = -2 * size_y * sin;
+		matrix[4] = 2 * size_y * cos;
+		matrix[5] = 0;
+		matrix[6] = pos_x - size_x * cos + size_y * sin;
+		matrix[7] = pos_y - size_y * cos - size_x * sin;
+		matrix[8] = 1;
+	}
+
+	void writeSpriteMatrices(const TransformComponent* transforms, u32 count, u8* output, u32 stride) {
+		u32 i = 0;
+#ifdef FLO_SSE2
+		alignas(16) float m00[4], m01[4], m10[4], m11[4], tx[4], ty[4];
+		for (; i + 4 <= count; i += 4) {
+			const TransformComponent* t = transforms + i;
+			const __m128 pos_x = _mm_setr_ps(t[0].pos.x, t[1].pos.x, t[2].pos.x, t[3].pos.x);
+			const __m128 pos_y = _mm_setr_ps(t[0].pos.y, t[1].pos.y, t[2].pos.y, t[3].pos.y);
+			const __m128 size_x = _mm_setr_ps(t[0].size.x, t[1].size.x, t[2].size.x, t[3].size.x);
+			const __m128 size_y = _mm_setr_ps(t[0].size.y, t[1].size.y, t[2].size.y, t[3].size.y);
+			__m128 sin, cos;
+			sin_cos_4(_mm_setr_ps(t[0].angle, t[1].angle, t[2].angle, t[3].angle), sin, cos);
+
+			const __m128 two = _mm_set1_ps(2.f);
+			const __m128 x_cos = _mm_mul_ps(size_x, cos), x_sin = _mm_mul_ps(size_x, sin);
+			const __m128 y_cos = _mm_mul_ps(size_y, cos), y_sin = _mm_mul_ps(size_y, sin);
+			_mm_store_ps(m00, _mm_mul_ps(two, x_cos));
+			_mm_store_ps(m01, _mm_mul_ps(two, x_sin));
+			_mm_store_ps(m10, _mm_mul_ps(two, _mm_sub_ps(_mm_setzero_ps(), y_sin)));
+			_mm_store_ps(m11, _mm_mul_ps(two, y_cos));
+			_mm_store_ps(tx, _mm_add_ps(_mm_sub_ps(pos_x, x_cos), y_sin));
+			_mm_store_ps(ty, _mm_sub_ps(_mm_sub_ps(pos_y, y_cos), x_sin));
+
+			for (u32 j = 0; j < 4; ++j) {
+				float* matrix = (float*)(output + (i + j) * stride);
+				matrix[0] = m00[j];
+				matrix[1] = m01[j];
+				matrix[2] = 0;
+				matrix[3] = m10[j];
+				matrix[4] = m11[j];
+				matrix[5] = 0;
+				matrix[6] = tx[j];
+				matrix[7] = ty[j];
+				matrix[8] = 1;
+			}
+		}
+#endif
+		for (; i < count; ++i) {
+			const TransformComponent& t = transforms[i];
+			writeSpriteMatrix((float*)(output + i * stride), t.pos.x, t.pos.y, t.size.x, t.size.y, std::sin(t.angle), std::cos(t.angle));
+		}
+	}
 }
@@ -1,145 +1,965 @@
 #pragma once
 #include <vector>
 #include <map>
+#include <new>
+#include <functional>
+#include <utility>
+#include <type_traits>
 
 #include "Types.h"
 
 #include "Matrices.h"
+#include "ThreadPool.h"
 
 namespace flo {
 	///<summary>
-	/// A hash for entities.
+	/// A hash for entities. The lower 32 bits are the index of the entity's slot, the upper 32 bits the generation of the slot.
+	/// Slots are recycled once their entity has been removed, with the generation increased so that stale hashes can be detected.
 	///</summary>
 	typedef u64 Entity;
 
+	///<summary>
+	/// Get the index of an entity's slot. Per-entity tables should be indexed by this.
+	///</summary>
+	inline u32 entityIndex(Entity entity) {
+		return (u32)entity;
+	}
+
+	///<summary>
+	/// Get the generation of an entity's slot.
+	///</summary>
+	inline u32 entityGeneration(Entity entity) {
+		return (u32)(entity >> 32);
+	}
+
+	///<summary>
+	/// Combine a slot index and a generation to an entity.
+	///</summary>
+	inline Entity makeEntity(u32 index, u32 generation) {
+		return ((Entity)generation << 32) | index;
+	}
+
 	extern const u32 invalid_index;
 
+	///<summary>
+	/// The size in bytes of one chunk of archetype storage.
+	///</summary>
+	extern const int data_chunk_size;
+
+	///<summary>
+	/// The amount of simulation levels of detail. Level 'l' updates an entity every 2^l frames.
+	///</summary>
+	const u32 lod_level_count = 4;
+
+	///<summary>
+	/// How the components of a type are stored.
+	///</summary>
+	enum ComponentStorage {
+		///<summary> Only a pointer to the component is stored; the caller owns the component. </summary>
+		storage_reference = 0,
+		///<summary> The component is copied into the chunks of an archetype and owned by the ECS. </summary>
+		storage_archetype = 1
+	};
+
+	///<summary>
+	/// Describes the memory layout and lifetime of a component type, so that the ECS can store it by value.
+	///</summary>
+	struct ComponentInfo {
+		typehash type = 0;
+		u32 size = 0, alignment = 1;
+
+		///<summary> Copy-construct the component at 'destination' from 'source'. </summary>
+		void (*copy)(u8* destination, const u8* source) = nullptr;
+
+		///<summary> Move-construct the component at 'destination' from 'source' and destroy 'source'. </summary>
+		void (*move)(u8* destination, u8* source) = nullptr;
+
+		///<summary> Destroy the component. </summary>
+		void (*destroy)(u8* data) = nullptr;
+
+		///<summary> Whether the component may be copied with memcpy and destroyed by doing nothing. </summary>
+		bool trivial = false;
+
+		ComponentInfo() = default;
+	};
+
+	///<summary>
+	/// Generate the ComponentInfo of a type.
+	///</summary>
+	template<typename T>
+	ComponentInfo generateComponentInfo() {
+		ComponentInfo info;
+		info.type = uniqueCode<T>();
+		info.size = sizeof(T);
+		info.alignment = alignof(T);
+		info.copy = [](u8* destination, const u8* source) { new (destination) T(*(const T*)source); };
+		info.move = [](u8* destination, u8* source) { new (destination) T(std::move(*(T*)source)); ((T*)source)->~T(); };
+		info.destroy = [](u8* data) { ((T*)data)->~T(); };
+		info.trivial = std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value;
+		return info;
+	}
+
+	///<summary>
+	/// A fixed-size block of memory holding the components of up to 'chunk_capacity' entities of one archetype.
+	/// The entities are stored first, followed by one tightly packed array per component type.
+	///</summary>
+	struct ArchetypeChunk {
+		u8* data = nullptr;
+		u32 count = 0;
+
+		///<summary>
+		/// The tick at which each component array of the chunk has last been written to, in the same order as the archetype's types.
+		///</summary>
+		std::vector<u32> changed_ticks;
+
+		///<summary>
+		/// The tick at which an entity has last been added to the chunk.
+		///</summary>
+		u32 added_tick = 0;
+
+		ArchetypeChunk() = default;
+	};
+
+	///<summary>
+	/// A storage for all entities that share the exact same set of component types.
+	///</summary>
+	struct Archetype {
+		///<summary>
+		/// The component types of the archetype, ordered from smallest to greatest. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<typehash> types;
+
+		///<summary>
+		/// The descriptions of all component types, in the same order as 'types'. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<ComponentInfo> infos;
+
+		///<summary>
+		/// The offset of every component array within a chunk, in the same order as 'types'. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u32> offsets;
+
+		///<summary>
+		/// All chunks. Only the last chunk may be partially filled. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<ArchetypeChunk> chunks;
+
+		///<summary>
+		/// How many entities fit into one chunk, and how large a chunk is in bytes. WARNING: READ-ONLY!
+		///</summary>
+		u32 chunk_capacity = 0, chunk_bytes = 0;
+
+		///<summary>
+		/// The amount of entities stored. WARNING: READ-ONLY!
+		///</summary>
+		u32 count = 0;
+
+		Archetype() = default;
+
+		///<summary>
+		/// Create an archetype and compute its chunk layout.
+		///</summary>
+		///<param name="infos">The component types of the archetype, in any order.</param>
+		Archetype(const std::vector<ComponentInfo>& infos);
+
+		///<summary>
+		/// Find the index of a component type within the archetype.
+		///</summary>
+		///<param name="type">The type of component.</param>
+		///<returns>The index of the type if it is present, invalid_index otherwhise.</returns>
+		u32 findType(typehash type);
+
+		///<summary>
+		/// Get the entities stored in a chunk.
+		///</summary>
+		///<param name="chunk">The index of the chunk.</param>
+		///<returns>An array of 'chunks[chunk].count' entities.</returns>
+		Entity* getEntities(u32 chunk);
+
+		///<summary>
+		/// Get the tightly packed array of one component type in a chunk.
+		///</summary>
+		///<param name="chunk">The index of the chunk.</param>
+		///<param name="type_index">The index of the type of component in the type array.</param>
+		///<returns>An array of 'chunks[chunk].count' components.</returns>
+		u8* getColumn(u32 chunk, u32 type_index);
+
+		///<summary>
+		/// Reserve a row for an entity. The components of the row are left unconstructed.
+		///</summary>
+		///<param name="entity">The entity to store.</param>
+		///<param name="chunk">Outputs the index of the chunk.</param>
+		///<param name="row">Outputs the index of the row within the chunk.</param>
+		///<param name="tick">The current change tick.</param>
+		void allocate(Entity entity, u32& chunk, u32& row, u32 tick);
+
+		///<summary>
+		/// Reserve consecutive rows for several entities, as many as fit into the last chunk or a new one. The components of the rows are left unconstructed.
+		///</summary>
+		///<param name="entities">The entities to store.</param>
+		///<param name="amount">The amount of entities.</param>
+		///<param name="chunk">Outputs the index of the chunk.</param>
+		///<param name="row">Outputs the index of the first row within the chunk.</param>
+		///<param name="tick">The current change tick.</param>
+		///<returns>The amount of rows reserved, which is at least one.</returns>
+		u32 allocate(const Entity* entities, u32 amount, u32& chunk, u32& row, u32 tick);
+
+		///<summary>
+		/// Rearrange all rows. Rows are numbered across chunks, so row 'r' lies in chunk 'r / chunk_capacity'.
+		/// The change ticks of every new chunk are the greatest of the chunks its rows came from.
+		///</summary>
+		///<param name="order">For every new row, the old row that is moved there. This has to be a permutation of all rows.</param>
+		void reorder(const std::vector<u32>& order);
+
+		///<summary>
+		/// Destroy the components of a row and fill the gap with the last entity of the archetype.
+		///</summary>
+		///<param name="chunk">The index of the chunk.</param>
+		///<param name="row">The index of the row within the chunk.</param>
+		///<param name="tick">The current change tick.</param>
+		///<param name="destroy">If false, the components of the row are expected to have been moved out already.</param>
+		///<returns>The entity that has been moved into the row, or 0 if no entity was moved.</returns>
+		Entity remove(u32 chunk, u32 row, u32 tick, bool destroy = true);
+
+		///<summary>
+		/// Destroy all components and free all chunks.
+		///</summary>
+		void dispose();
+	};
+
+	///<summary>
+	/// Where the by-value components of an entity are stored.
+	///</summary>
+	struct EntityLocation {
+		Archetype* archetype = nullptr;
+		u32 chunk = 0, row = 0;
+
+		EntityLocation() = default;
+	};
+
 	///<summary>
 	/// A struct for handling entities and components.
 	///</summary>
 	struct EntityComponentSystem;
 
-	///<summary>
-	/// A basic transform component.
-	///</summary>
-	struct TransformComponent {
-		glm::vec2 pos = glm::vec2(0.), size = glm::vec2(0.);
-		float angle = 0;
+	///<summary>
+	/// A typed query over all entities that have every component in 'Ts'.
+	///</summary>
+	template<typename... Ts>
+	struct ComponentView;
+
+	///<summary>
+	/// A basic transform component.
+	///</summary>
+	struct TransformComponent {
+		glm::vec2 pos = glm::vec2(0.), size = glm::vec2(0.);
+		float angle = 0;
+
+		TransformComponent() = default;
+		
+		///<summary>
+		/// Get the matrix defined by the component.
+		///</summary>
+		glm::mat3 getMatrix();
+
+		///<summary>
+		/// Generate the matrix such that it accurately applies for a sprite.
+		///</summary>
+		glm::mat3 getSpriteMatrix();
+	};
+
+	///<summary>
+	/// Compute getSpriteMatrix() for an array of transforms, four at a time with SSE, and write every matrix to 'output + i * stride'.
+	/// With 'output' pointing to the 'transform' of the first fgr::Sprite and 'stride' being sizeof(fgr::Sprite), the matrices are written
+	/// straight into sprite instances, e.g. the buffer returned by fgr::SpriteArray::mapInstances().
+	///</summary>
+	///<param name="transforms">The transforms, e.g. one chunk of a view.</param>
+	///<param name="count">The amount of transforms.</param>
+	///<param name="output">Where the first matrix is written to.</param>
+	///<param name="stride">The distance between two matrices in bytes.</param>
+	void writeSpriteMatrices(const TransformComponent* transforms, u32 count, u8* output, u32 stride);
+
+	///<summary>
+	/// Compute the Morton code (Z-order key) of the grid cell containing a position. Positions that are close to each other mostly get close codes.
+	///</summary>
+	///<param name="pos">The position.</param>
+	///<param name="cell_size">The size of a grid cell.</param>
+	///<returns>The bits of both cell coordinates, interleaved.</returns>
+	u64 mortonCode(glm::vec2 pos, float cell_size);
+
+	///<summary>
+	/// An abstract base struct for systems. Such systems handle behavior of entities.
+	///</summary>
+	struct System {
+		EntityComponentSystem* parent_ecs;
+
+		///<summary>
+		/// The change tick at which update() has last been started by EntityComponentSystem::runSystems().
+		/// Pass this to ComponentView::changedSince() to only process what has changed since.
+		///</summary>
+		u32 last_run_tick = 0;
+
+		///<summary>
+		/// The component types the system reads from and writes to in update(). Systems that declare neither
+		/// are assumed to access everything and never run alongside other systems.
+		///</summary>
+		std::vector<typehash> read_access, write_access;
+
+		///<summary>
+		/// A callback for when the System is registered. Access should be declared here.
+		///</summary>
+		virtual void onRegistered() = 0;
+
+		///<summary>
+		/// Update the system. This is called by EntityComponentSystem::runSystems(), possibly from a worker thread.
+		///</summary>
+		///<param name="dt">The time since the last update.</param>
+		virtual void update(float dt) {}
+
+		///<summary>
+		/// Declare that update() reads the given component types.
+		///</summary>
+		template<typename... Ts>
+		void declareReads() {
+			read_access.insert(read_access.end(), { uniqueCode<Ts>()... });
+		}
+
+		///<summary>
+		/// Declare that update() writes to the given component types.
+		///</summary>
+		template<typename... Ts>
+		void declareWrites() {
+			write_access.insert(write_access.end(), { uniqueCode<Ts>()... });
+		}
+
+		///<summary>
+		/// Check whether two systems may not run at the same time.
+		///</summary>
+		///<param name="other">The other system.</param>
+		///<returns>True if either system writes a type the other one accesses, or if either declared no access at all.</returns>
+		bool conflictsWith(const System& other) const;
+
+		///<summary>
+		/// A callback for when an entity is added to the parent.
+		///</summary>
+		virtual void entityAdded(Entity entity) = 0;
+
+		///<summary>
+		/// A callback for when an entity is freed from the parent.
+		///</summary>
+		virtual void entityDestroyed(Entity entity) = 0;
+
+		///<summary>
+		/// A callback for all entities that have been added to the parent since the last notification. By default, entityAdded() is called for each of them.
+		///</summary>
+		///<param name="entities">The added entities.</param>
+		///<param name="count">The amount of entities.</param>
+		virtual void entitiesAdded(const Entity* entities, u32 count);
+
+		///<summary>
+		/// A callback for all entities that have been freed from the parent since the last notification. By default, entityDestroyed() is called for each of them.
+		///</summary>
+		///<param name="entities">The freed entities. Their hashes are no longer valid.</param>
+		///<param name="count">The amount of entities.</param>
+		virtual void entitiesDestroyed(const Entity* entities, u32 count);
+	};
+
+	///<summary>
+	/// A paged lookup table from entities to indices in a dense array. Lookups, insertions and removals take constant time.
+	/// Entities are keyed by their slot index, so the caller has to compare the stored entity to detect stale hashes.
+	///</summary>
+	struct SparseIndex {
+		///<summary>
+		/// The amount of entities covered by one page.
+		///</summary>
+		static const u32 page_size = 4096;
+
+		///<summary>
+		/// The pages of the table. Pages that have never been written to are empty. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<std::vector<u32>> pages;
+
+		SparseIndex() = default;
+
+		///<summary>
+		/// Get the index associated with an entity.
+		///</summary>
+		///<param name="entity">The entity in question.</param>
+		///<returns>The index if one has been set, invalid_index otherwhise.</returns>
+		u32 get(Entity entity) const;
+
+		///<summary>
+		/// Associate an index with an entity.
+		///</summary>
+		///<param name="entity">The entity in question.</param>
+		///<param name="index">The index to associate.</param>
+		void set(Entity entity, u32 index);
+
+		///<summary>
+		/// Remove the index associated with an entity.
+		///</summary>
+		///<param name="entity">The entity in question.</param>
+		void erase(Entity entity);
+	};
+
+	///<summary>
+	/// The entities that carry a tag, a component type without data, stored as one bit per entity slot.
+	/// Tags of removed entities are cleared, so a set bit always belongs to the entity currently occupying the slot.
+	///</summary>
+	struct TagSet {
+		///<summary>
+		/// The bits, 64 slots per word. Words past the end are zero. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u64> words;
+
+		TagSet() = default;
+
+		///<summary>
+		/// Set the bit of a slot.
+		///</summary>
+		///<param name="index">The slot index of the entity.</param>
+		void set(u32 index);
+
+		///<summary>
+		/// Clear the bit of a slot.
+		///</summary>
+		///<param name="index">The slot index of the entity.</param>
+		void reset(u32 index);
+
+		///<summary>
+		/// Get the bit of a slot.
+		///</summary>
+		///<param name="index">The slot index of the entity.</param>
+		///<returns>True if the bit is set.</returns>
+		bool test(u32 index) const;
+	};
+
+	///<summary>
+	/// A pool of equally sized slots for components that are owned by the ECS but not stored in archetypes.
+	/// Slots are cut from blocks of 'data_chunk_size' bytes and recycled, so a component does not need a heap allocation of its own.
+	///</summary>
+	struct ComponentPool {
+		///<summary>
+		/// The description of the pooled type. WARNING: READ-ONLY!
+		///</summary>
+		ComponentInfo info;
+
+		///<summary>
+		/// The size of one slot including padding, and how many slots fit into a block. WARNING: READ-ONLY!
+		///</summary>
+		u32 slot_size = 0, slots_per_block = 0;
+
+		///<summary>
+		/// All allocated blocks. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u8*> blocks;
+
+		///<summary>
+		/// All slots that are currently unused. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u8*> free_slots;
+
+		ComponentPool() = default;
+
+		///<summary>
+		/// Create a pool for a type of component.
+		///</summary>
+		///<param name="info">The description of the type.</param>
+		ComponentPool(const ComponentInfo& info);
+
+		///<summary>
+		/// Get an unused slot. The component is left unconstructed.
+		///</summary>
+		///<returns>A pointer to the slot.</returns>
+		u8* allocate();
+
+		///<summary>
+		/// Destroy a component and return its slot to the pool.
+		///</summary>
+		///<param name="slot">A slot returned by allocate() that holds a constructed component.</param>
+		void release(u8* slot);
+
+		///<summary>
+		/// Free all blocks. All components must have been released before.
+		///</summary>
+		void dispose();
+	};
+
+	///<summary>
+	/// A container for components, stored as a sparse set.
+	///</summary>
+	struct ComponentArray {
+		///<summary>
+		/// The type of the components.
+		///</summary>
+		typehash data_type;
+
+		///<summary>
+		/// References to all components as abstract pointers.
+		///</summary>
+		std::vector<u8*> data;
+
+		///<summary>
+		/// All hashes to which the components belong, in the same order as the components.
+		///</summary>
+		std::vector<Entity> map;
+
+		///<summary>
+		/// The index of every entity's component within 'data' and 'map'.
+		///</summary>
+		SparseIndex sparse;
+
+		///<summary>
+		/// The tick at which each component has last been written to or added, in the same order as the components.
+		///</summary>
+		std::vector<u32> changed_ticks, added_ticks;
+
+		///<summary>
+		/// Whether each component has been allocated from 'pool' and therefore has to be released when it is removed, in the same order as the components.
+		///</summary>
+		std::vector<bool> owned;
+
+		///<summary>
+		/// The pool of the components created through EntityComponentSystem::emplace(). nullptr until the first such component.
+		///</summary>
+		ComponentPool* pool = nullptr;
+
+		///<summary>
+		/// Create a ComponentArray. This is the only availibe constructor.
+		///</summary>
+		///<param name="type">The type of component that will be stored. This can also be a base class.</param>
+		ComponentArray(typehash type);
+
+		///<summary>
+		/// Add a component. If the entity already has a component, it is replaced. You do not need to call this manually.
+		///</summary>
+		///<param name="entity">The entity to which the component belongs.</param>
+		///<param name="data">A pointer to the component.</param>
+		///<param name="tick">The current change tick.</param>
+		///<param name="owned">Whether the component has been allocated from 'pool'.</param>
+		void addComponent(Entity entity, u8* data, u32 tick, bool owned = false);
+
+		///<summary>
+		/// Remove a component. The last component is moved into the gap. Owned components are released. You do not need to call this manually.
+		///</summary>
+		///<param name="entity">The entity to which the component belongs.</param>
+		void removeComponent(Entity entity);
+		
+		///<summary>
+		/// Find the index of a component in the array.
+		///</summary>
+		///<param name="entity">The entity to which the component belongs.</param>
+		///<returns>The index of the component in the array if it is present, invalid_index otherwhise.</returns>
+		u32 findEntity(Entity entity);
+
+		///<summary>
+		/// Get a component from the array.
+		///</summary>
+		///<param name="entity">The entity to which the component belongs.</param>
+		///<returns>The component if found, nullptr otherwhise.</returns>
+		u8* getData(Entity entity);
+
+		///<summary>
+		/// Mark a component as changed.
+		///</summary>
+		///<param name="entity">The entity to which the component belongs.</param>
+		///<param name="tick">The current change tick.</param>
+		void markChanged(Entity entity, u32 tick);
+	};
+
+	///<summary>
+	/// Records structural changes (entity creation and destruction, added components) so that they can be applied later,
+	/// at a point where no system iterates the ECS. Every thread gets its own buffer through EntityComponentSystem::getCommandBuffer().
+	///</summary>
+	struct CommandBuffer {
+		enum CommandType {
+			command_create = 0,
+			command_add = 1,
+			command_destroy = 2
+		};
+
+		///<summary>
+		/// A recorded command. Commands of an entity are ordered by the index of their buffer and their sequence within it,
+		/// so that playback does not depend on the order in which the buffers are stored.
+		///</summary>
+		struct Command {
+			Entity entity;
+			CommandType type;
+			typehash component;
+			u8* data;
+			u32 buffer, sequence;
+		};
+
+		EntityComponentSystem* parent_ecs = nullptr;
+
+		///<summary>
+		/// The position of the buffer in the order in which buffers were requested. WARNING: READ-ONLY!
+		///</summary>
+		u32 index = 0;
+
+		///<summary>
+		/// All recorded commands, in the order they were recorded in. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<Command> commands;
+
+		///<summary>
+		/// Memory blocks holding copies of components stored in archetypes. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u8*> blocks;
+		u32 block_offset = 0;
+
+		CommandBuffer() = default;
+
+		CommandBuffer(EntityComponentSystem& parent_ecs, u32 index);
+
+		///<summary>
+		/// Reserve a new entity, which will be created on playback.
+		///</summary>
+		///<returns>The hash of the entity. It may already be used for further commands.</returns>
+		Entity registerEntity();
+
+		///<summary>
+		/// Add a component to an entity, either one reserved by this buffer or an existing one.
+		/// Components stored in archetypes are copied immediately, components stored by reference must stay valid.
+		///</summary>
+		///<param name="entity">The entity in question.</param>
+		///<param name="type">The type of component.</param>
+		///<param name="data">A pointer to the component.</param>
+		void addComponent(Entity entity, typehash type, void* data);
+
+		///<summary>
+		/// Destroy an entity on playback.
+		///</summary>
+		///<param name="entity">The entity in question.</param>
+		void removeEntity(Entity entity);
+
+		///<summary>
+		/// Destroy the copied components and forget all commands. You do not need to call this manually.
+		///</summary>
+		void clear();
+
+		///<summary>
+		/// Clear the buffer and free all memory.
+		///</summary>
+		void dispose();
+
+	private:
+		u8* allocate(u32 size, u32 alignment);
+	};
+
+	///<summary>
+	/// A set of components with initial values, from which any amount of identical entities can be created with EntityComponentSystem::instantiate().
+	///</summary>
+	struct Prefab {
+		///<summary>
+		/// The descriptions of all component types, ordered by type. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<ComponentInfo> infos;
+
+		///<summary>
+		/// Copies of all components, in the same order as 'infos'. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u8*> values;
+
+		Prefab() = default;
+
+		///<summary>
+		/// Copy a component into the prefab, replacing any component of the same type.
+		///</summary>
+		///<param name="value">The initial value of the component.</param>
+		template<typename T>
+		void set(const T& value) {
+			setComponent(generateComponentInfo<T>(), (const u8*)&value);
+		}
+
+		///<summary>
+		/// Copy a component into the prefab, replacing any component of the same type.
+		///</summary>
+		///<param name="info">The description of the type of component.</param>
+		///<param name="value">A pointer to the initial value of the component.</param>
+		void setComponent(const ComponentInfo& info, const u8* value);
+
+		///<summary>
+		/// Get the initial value of a component.
+		///</summary>
+		///<param name="type">The type of component.</param>
+		///<returns>A pointer to the value if the prefab has such a component, nullptr otherwhise.</returns>
+		u8* getComponent(typehash type);
+
+		///<summary>
+		/// Destroy all components of the prefab.
+		///</summary>
+		void dispose();
+	};
+
+	struct EntityComponentSystem {
+		///<summary>
+		/// A map containing all components of the ECS. WARNING: READ-ONLY!
+		///</summary>
+		std::map<typehash, ComponentArray> componentArrays;
+
+		///<summary>
+		/// The descriptions of all component types stored in archetypes. WARNING: READ-ONLY!
+		///</summary>
+		std::map<typehash, ComponentInfo> componentInfos;
+
+		///<summary>
+		/// All archetypes, keyed by their ordered component types. WARNING: READ-ONLY!
+		///</summary>
+		std::map<std::vector<typehash>, Archetype*> archetypes;
+
+		///<summary>
+		/// The archetype location of every entity, indexed by the entity's slot index. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<EntityLocation> locations;
+
+		///<summary>
+		/// All registered systems. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<System*> systems;
+
+		///<summary>
+		/// The hash of the entity that is currently being created. WARNING: READ-ONLY!
+		///</summary>
+		Entity current_entity = 0;
+
+		///<summary>
+		/// The current generation of every entity slot. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u32> generations;
+
+		///<summary>
+		/// The indices of all slots whose entity has been removed. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u32> free_slots;
+		std::mutex entity_mutex;
+
+		///<summary>
+		/// The current change tick. It is increased whenever runSystems() starts a system, and once more after all systems are done. WARNING: READ-ONLY!
+		///</summary>
+		std::atomic<u32> change_tick;
+
+		///<summary>
+		/// Removed entities along with the change tick of their removal. Entries that every system has seen are discarded by runSystems(). WARNING: READ-ONLY!
+		///</summary>
+		std::vector<std::pair<Entity, u32>> removed_entities;
+
+		///<summary>
+		/// The simulation level of detail of every entity slot. An entity of level 'l' is updated every 2^l frames; see updateLOD(). WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u8> lod_levels;
+
+		///<summary>
+		/// The amount of frames runSystems() has started, and the total time of them. WARNING: READ-ONLY!
+		///</summary>
+		u32 lod_frame = 0;
+		double lod_time = 0;
+
+		///<summary>
+		/// The total time at the end of each of the last frames, indexed by the frame modulo 16. WARNING: READ-ONLY!
+		///</summary>
+		double lod_frame_times[16] = {};
+
+		///<summary>
+		/// The frame after which the level of every entity slot has last changed, and the total time at the end of the frame
+		/// the slot was last due in until then. Slots are only written when their level changes, so frames cost nothing per slot. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u32> lod_changed_frames;
+		std::vector<double> lod_due_times;
+
+		///<summary>
+		/// The command buffer of every thread that requested one. WARNING: READ-ONLY!
+		///</summary>
+		std::map<std::thread::id, CommandBuffer*> command_buffers;
+		std::mutex command_buffer_mutex;
+
+		///<summary>
+		/// Identifies the current set of command buffers, so that threads can cache their buffer. It is unique among all ECSs
+		/// and renewed when the buffers are freed. WARNING: READ-ONLY!
+		///</summary>
+		u32 command_buffer_generation;
+
+		///<summary>
+		/// The pool used by runSystems() and by parallel iteration of views. If nullptr, everything runs on the calling thread.
+		///</summary>
+		ThreadPool* thread_pool = nullptr;
+
+		///<summary>
+		/// For every system, the later systems that conflict with it and therefore wait for it. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<std::vector<u32>> system_dependents;
+
+		///<summary>
+		/// For every system, the amount of earlier systems it conflicts with. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u32> system_dependencies;
+
+		///<summary>
+		/// The archetype components added to the entity that is currently being created. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<std::pair<typehash, const u8*>> staged_components;
+
+		///<summary>
+		/// The staged components that have been constructed by emplace() and are released once the entity is finalized. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<std::pair<typehash, u8*>> owned_staged_components;
 
-		TransformComponent() = default;
-		
 		///<summary>
-		/// Get the matrix defined by the component.
+		/// Whether the entity that is currently being created has not been finalized yet. WARNING: READ-ONLY!
 		///</summary>
-		glm::mat3 getMatrix();
+		bool creating_entity = false;
 
 		///<summary>
-		/// Generate the matrix such that it accurately applies for a sprite.
+		/// The pools of all component types that have been emplaced. WARNING: READ-ONLY!
 		///</summary>
-		glm::mat3 getSpriteMatrix();
-	};
+		std::map<typehash, ComponentPool> component_pools;
 
-	///<summary>
-	/// An abstract base struct for systems. Such systems handle behavior of entities.
-	///</summary>
-	struct System {
-		EntityComponentSystem* parent_ecs;
+		///<summary>
+		/// The entities that have been finalized and removed since the systems have last been notified. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<Entity> pending_added, pending_destroyed;
 
 		///<summary>
-		/// A callback for when the System is registered.
+		/// The bitsets of all registered tags. WARNING: READ-ONLY!
 		///</summary>
-		virtual void onRegistered() = 0;
+		std::map<typehash, TagSet> tag_sets;
 
 		///<summary>
-		/// A callback for when an entity is added to the parent.
+		/// Create an ECS.
 		///</summary>
-		virtual void entityAdded(Entity entity) = 0;
+		EntityComponentSystem();
 
 		///<summary>
-		/// A callback for when an entity is freed from the parent.
+		/// Register a type of component. This creates all storages neccessary. The components will be stored by reference.
+		/// If the type has already been registered, this does nothing.
 		///</summary>
-		virtual void entityDestroyed(Entity entity) = 0;
-	};
+		///<param name="type">The type of component.</param>
+		void registerComponent(typehash type);
 
-	///<summary>
-	/// A container for components.
-	///</summary>
-	struct ComponentArray {
 		///<summary>
-		/// The type of the components.
+		/// Register a type of component with a given storage. If the type has already been registered, this does nothing.
 		///</summary>
-		typehash data_type;
+		///<param name="info">The description of the type of component.</param>
+		///<param name="storage">How the components are to be stored.</param>
+		void registerComponent(const ComponentInfo& info, ComponentStorage storage);
 
 		///<summary>
-		/// References to all components as abstract pointers.
+		/// Register a type of component. By default, the components will be copied into archetype chunks.
+		/// If the type has already been registered, this does nothing.
 		///</summary>
-		std::vector<u8*> data;
+		///<param name="storage">How the components are to be stored.</param>
+		template<typename T>
+		void registerComponent(ComponentStorage storage = storage_archetype) {
+			registerComponent(generateComponentInfo<T>(), storage);
+		}
 
 		///<summary>
-		/// All hashes to which the components belong, ordered from smallest to greatest.
+		/// Assign every entity with a TransformComponent a simulation level of detail by its distance to a focus point, usually the center of the View or Camera.
+		/// Entities closer than 'distance' get level 0 and are updated every frame; every doubling of the distance halves the rate, down to every eighth frame.
+		/// This has to be called whenever entities have moved noticeably, e.g. every few frames; it must not be called while systems are running.
 		///</summary>
-		std::vector<Entity> map;
+		///<param name="focus">The point at which the simulation runs at full rate.</param>
+		///<param name="distance">The distance up to which the simulation runs at full rate.</param>
+		void updateLOD(glm::vec2 focus, float distance);
 
 		///<summary>
-		/// Create a ComponentArray. This is the only availibe constructor.
+		/// Set the simulation level of detail of a single entity.
 		///</summary>
-		///<param name="type">The type of component that will be stored. This can also be a base class.</param>
-		ComponentArray(typehash type);
+		///<param name="entity">The entity in question.</param>
+		///<param name="level">The level, from 0 (every frame) to 3 (every eighth frame).</param>
+		void setLOD(Entity entity, u32 level);
 
 		///<summary>
-		/// Add a component. You do not need to call this manually.
+		/// Set the simulation level of detail of an entity slot, remembering when it was last due under its previous level.
 		///</summary>
-		///<param name="entity">The entity to which the component belongs.</param>
-		///<param name="data">A pointer to the component.</param>
-		void addComponent(Entity entity, u8* data);
+		///<param name="index">The index of the entity slot.</param>
+		///<param name="level">The level, from 0 to 3.</param>
+		///<param name="reset">Whether the slot counts as due in the current frame, for slots whose entity has been removed.</param>
+		void assignLOD(u32 index, u32 level, bool reset = false);
 
 		///<summary>
-		/// Remove a component. You do not need to call this manually.
+		/// Check whether an entity is to be simulated in the current frame. Entities of the same level are spread evenly across frames.
 		///</summary>
-		///<param name="entity">The entity to which the component belongs.</param>
-		void removeComponent(Entity entity);
-		
+		///<param name="entity">The entity in question.</param>
+		///<param name="dt">Outputs the time that has passed since the entity has last been due.</param>
+		///<returns>True if the entity is due.</returns>
+		bool isScheduled(Entity entity, float& dt) const {
+			const u32 index = entityIndex(entity);
+			dt = (float)(lod_time - getDueTime(index, lod_frame - 1));
+			return isDue(index);
+		}
+
 		///<summary>
-		/// Find the index of a component in the array.
+		/// Check whether the entity in a slot is due in the current frame.
 		///</summary>
-		///<param name="entity">The entity to which the component belongs.</param>
-		///<returns>The index of the component in the array if it is present, invalid_index otherwhise.</returns>
-		u32 findEntity(Entity entity);
+		///<param name="index">The index of the entity slot.</param>
+		///<returns>True if the slot is due.</returns>
+		bool isDue(u32 index) const {
+			const u32 level = index < lod_levels.size() ? lod_levels[index] : 0;
+			return ((lod_frame + index) & ((1u << level) - 1)) == 0;
+		}
 
 		///<summary>
-		/// Get a component from the array.
+		/// Get the total time at the end of the last frame up to a given one in which the entity in a slot was due.
 		///</summary>
-		///<param name="entity">The entity to which the component belongs.</param>
-		///<returns>The component if found, nullptr otherwhise.</returns>
-		u8* getData(Entity entity);
-	};
+		///<param name="index">The index of the entity slot.</param>
+		///<param name="frame">The latest frame to consider, either the current or the previous one.</param>
+		///<returns>The total time at the end of that frame.</returns>
+		double getDueTime(u32 index, u32 frame) const {
+			const u32 level = index < lod_levels.size() ? lod_levels[index] : 0;
+			const u32 changed = index < lod_changed_frames.size() ? lod_changed_frames[index] : 0;
+			const u32 offset = (frame + index) & ((1u << level) - 1);
+			//frames before the level changed do not count for the current level
+			if (frame - changed <= offset) return index < lod_due_times.size() ? lod_due_times[index] : 0;
+			return lod_frame_times[(frame - offset) & 15];
+		}
 
-	struct EntityComponentSystem {
 		///<summary>
-		/// A map containing all components of the ECS. WARNING: READ-ONLY!
+		/// Register a tag, a component type without data that costs one bit per entity. If the tag has already been registered, this does nothing.
 		///</summary>
-		std::map<typehash, ComponentArray> componentArrays;
+		///<param name="type">The type of the tag.</param>
+		void registerTag(typehash type);
 
 		///<summary>
-		/// All registered systems. WARNING: READ-ONLY!
+		/// Register a tag. T has to be an empty struct.
 		///</summary>
-		std::vector<System*> systems;
+		template<typename T>
+		void registerTag() {
+			static_assert(std::is_empty<T>::value, "Tags can not hold data.");
+			registerTag(uniqueCode<T>());
+		}
 
 		///<summary>
-		/// The hash of the entity that is currently being created. WARNING: READ-ONLY!
+		/// Tag an entity. This may be called for the entity that is currently being created as well.
 		///</summary>
-		Entity current_entity = 0;
+		///<param name="entity">The entity in question.</param>
+		///<param name="type">The type of the tag.</param>
+		void addTag(Entity entity, typehash type);
 
 		///<summary>
-		/// Create an ECS.
+		/// Remove a tag from an entity.
 		///</summary>
-		EntityComponentSystem();
+		///<param name="entity">The entity in question.</param>
+		///<param name="type">The type of the tag.</param>
+		void removeTag(Entity entity, typehash type);
 
 		///<summary>
-		/// Register a type of component. This creates all storages neccessary.
+		/// Check whether an entity carries a tag.
 		///</summary>
-		///<param name="type">The type of component.</param>
-		void registerComponent(typehash type);
+		///<param name="entity">The entity in question.</param>
+		///<param name="type">The type of the tag.</param>
+		///<returns>True if the entity is alive and tagged.</returns>
+		bool hasTag(Entity entity, typehash type);
+
+		///<summary>
+		/// Combine tags into one mask with one bit per entity slot, a word at a time: a bit is set if the slot carries every tag of 'with' and none of 'without'.
+		/// Tags in 'without' that have not been registered are ignored.
+		///</summary>
+		///<param name="with">The tags that are required.</param>
+		///<param name="without">The tags that are excluded.</param>
+		///<param name="mask">Outputs the mask, covering all slots.</param>
+		///<returns>False if a tag in 'with' has not been registered, in which case no entity can match.</returns>
+		bool buildTagMask(const std::vector<typehash>& with, const std::vector<typehash>& without, std::vector<u64>& mask);
 
 		///<summary>
 		/// Register a system. This system will now receive callbacks.
@@ -147,6 +967,13 @@ namespace flo {
 		///<param name="system">A pointer to the system in question.</param>
 		void registerSystem(System* system);
 
+		///<summary>
+		/// Update all systems and play back all command buffers afterwards. Systems that do not conflict run in parallel on the thread pool;
+		/// conflicting systems run in the order they have been registered in. Pending entity notifications are sent before and after.
+		///</summary>
+		///<param name="dt">The time since the last update.</param>
+		void runSystems(float dt);
+
 		///<summary>
 		/// Register a new entity.
 		///</summary>
@@ -154,23 +981,159 @@ namespace flo {
 		Entity registerEntity();
 
 		///<summary>
-		/// Destroy an entity.
+		/// Reserve the hash of a new entity without creating it. This is thread-safe.
+		///</summary>
+		///<returns>The hash</returns>
+		Entity reserveEntity();
+
+		///<summary>
+		/// Reserve the hashes of several new entities at once. This is thread-safe.
+		///</summary>
+		///<param name="output">An array the hashes are written to.</param>
+		///<param name="count">The amount of entities.</param>
+		void reserveEntities(Entity* output, u32 count);
+
+		///<summary>
+		/// Create entities that are copies of a prefab. The archetype components are copied chunk by chunk, using memcpy for trivial types,
+		/// and the systems are told about all new entities in one batch on the next notifySystems().
+		/// Components whose type has not been registered are skipped.
+		///</summary>
+		///<param name="prefab">The prefab to copy.</param>
+		///<param name="count">The amount of entities to create.</param>
+		///<param name="output">The vector the new entities are appended to.</param>
+		void instantiate(const Prefab& prefab, u32 count, std::vector<Entity>& output);
+
+		///<summary>
+		/// Check whether an entity hash is still valid, meaning that its entity has not been removed. This is thread-safe.
+		///</summary>
+		///<param name="entity">The hash of the entity in question.</param>
+		///<returns>True if the entity has not been removed.</returns>
+		bool isAlive(Entity entity);
+
+		///<summary>
+		/// Add a component to an entity that has already been finalized. Components stored in archetypes are copied immediately,
+		/// which moves the entity to another archetype.
+		///</summary>
+		///<param name="entity">The entity in question.</param>
+		///<param name="type">The type of component.</param>
+		///<param name="data">A pointer to the component.</param>
+		void addComponent(Entity entity, typehash type, void* data);
+
+		///<summary>
+		/// Construct a component in place and add it to an entity, either the one that is currently being created or one that has already been finalized.
+		/// The ECS owns the component: it is stored in an archetype chunk or in a pooled slot, and destroyed when it is replaced or its entity is removed.
+		///</summary>
+		///<param name="entity">The entity in question.</param>
+		///<param name="args">The arguments passed to the constructor of T.</param>
+		///<returns>A pointer to the component, or nullptr if T has not been registered or the entity has been removed.</returns>
+		template<typename T, typename... Args>
+		T* emplace(Entity entity, Args&&... args) {
+			u8* component = allocateComponent(entity, generateComponentInfo<T>());
+			if (!component) return nullptr;
+			return new (component) T(std::forward<Args>(args)...);
+		}
+
+		///<summary>
+		/// Reserve the memory of a component owned by the ECS and add it to an entity. Use emplace() instead.
+		/// The component is left unconstructed and has to be constructed before the ECS is used again.
+		///</summary>
+		///<param name="entity">The entity in question.</param>
+		///<param name="info">The description of the type of component.</param>
+		///<returns>A pointer to the memory, or nullptr if the type has not been registered or the entity has been removed.</returns>
+		u8* allocateComponent(Entity entity, const ComponentInfo& info);
+
+		///<summary>
+		/// Destroy the components emplace() staged for the entity that is currently being created and forget all staged components.
+		/// You do not need to call this manually.
+		///</summary>
+		void releaseStagedComponents();
+
+		///<summary>
+		/// Drop the staged component of a type from the entity that is currently being created, so that every type is staged at most once.
+		/// You do not need to call this manually.
+		///</summary>
+		///<param name="type">The type of component.</param>
+		void unstageComponent(typehash type);
+
+		///<summary>
+		/// Hand all entities that have been finalized or removed since the last call to the systems, one batch per system and callback.
+		/// Entities that have been removed before they were announced are left out of both batches. This is called by runSystems(),
+		/// but may be called manually, for example after loading a level.
+		///</summary>
+		void notifySystems();
+
+		///<summary>
+		/// Advance the change tick, play back all command buffers and discard removal records every system has seen.
+		/// This is called by runSystems(); you do not need to call this manually.
+		///</summary>
+		void finishSystems();
+
+		///<summary>
+		/// Get the command buffer of the calling thread. This is thread-safe; after the first call, a thread finds its buffer without locking.
+		///</summary>
+		///<returns>The command buffer, which remains valid until the ECS is disposed.</returns>
+		CommandBuffer& getCommandBuffer();
+
+		///<summary>
+		/// Apply the commands of all command buffers, sorted by entity and then by the order they were recorded in, and clear the buffers.
+		/// This must not be called while systems are running.
+		/// With a thread pool the playback is not fully reproducible: buffers are indexed in the order threads first requested one,
+		/// and entities created through buffers get their slots in the order threads reserved them, both of which depend on scheduling.
+		/// The commands recorded by one thread are still applied in the order they were recorded in.
+		///</summary>
+		void playbackCommands();
+
+		///<summary>
+		/// Destroy an entity and recycle its slot. Stale hashes are ignored. The systems are told on the next notifySystems(),
+		/// which runSystems() calls; code that drives systems without runSystems() has to call notifySystems() itself.
 		///</summary>
 		///<param name="entity">The hash of the entity in question.</param>
 		void removeEntity(Entity entity);
 
 		///<summary>
-		/// Add a component to the entity that is currently being created. Note that only one instance of a component type can be added.
+		/// Add a component to the entity that is currently being created. Note that only one instance of a component type can be added; adding a type again replaces it.
+		/// Components stored in archetypes are copied when the entity is finalized, so the pointer only has to remain valid until then.
 		///</summary>
 		///<param name="type">The type of component.</param>
 		///<param name="data">A pointer to the component.</param>
 		void addComponent(typehash type, void* data);
 
 		///<summary>
-		/// Call the entityAdded() callback for all systems with the newest entity.
+		/// Move the archetype components of the newest entity into their chunks
+		/// and queue the newest entity for the next notifySystems(). System::entityAdded() is not called synchronously:
+		/// runSystems() notifies the systems, code that drives systems without runSystems() has to call notifySystems() itself.
 		///</summary>
 		void finalizeEntity();
 
+		///<summary>
+		/// Sort the rows of every archetype by the Morton code of their TransformComponent, so that entities close to each other
+		/// are stored close to each other as well. Entity hashes stay valid, but pointers to archetype components do not.
+		/// Archetypes that are already in order are skipped, so this is cheap to call periodically, e.g. every few frames.
+		/// This must not be called while systems are running.
+		///</summary>
+		///<param name="cell_size">The size of the grid cells whose entities are considered equally close; roughly the size of a typical entity.</param>
+		void sortSpatially(float cell_size);
+
+		///<summary>
+		/// Get the archetype of a set of component types, creating it if neccessary.
+		///</summary>
+		///<param name="types">The types of components, ordered from smallest to greatest. All of them must be stored in archetypes.</param>
+		///<returns>A pointer to the archetype.</returns>
+		Archetype* getArchetype(const std::vector<typehash>& types);
+
+		///<summary>
+		/// Call a function for every chunk of every archetype containing all given types.
+		/// The columns are passed in the same order as the types.
+		///</summary>
+		///<param name="types">The types of components to query. All of them must be stored in archetypes.</param>
+		///<param name="callback">The function to call with the entities, the component arrays and the amount of entities in the chunk.</param>
+		void forEachChunk(const std::vector<typehash>& types, const std::function<void(Entity* entities, u8** columns, u32 count)>& callback);
+
+		///<summary>
+		/// Destroy all components owned by the ECS and free their memory.
+		///</summary>
+		void dispose();
+
 		///<summary>
 		/// Get a ComponentArray.
 		///</summary>
@@ -186,6 +1149,51 @@ namespace flo {
 		///<returns>A pointer to the component if found, nullptr otherwhise.</returns>
 		u8* getComponent(typehash component_type, Entity entity);
 
+		///<summary>
+		/// Mark the component of an entity as changed. Components written to through non-const views are marked automatically.
+		///</summary>
+		///<param name="component_type">The type of component.</param>
+		///<param name="entity">The entity to which the component belongs.</param>
+		void markChanged(typehash component_type, Entity entity);
+
+		///<summary>
+		/// Get the tick at which the component of an entity has last been changed. Components stored in archetypes are tracked per chunk.
+		///</summary>
+		///<param name="component_type">The type of component.</param>
+		///<param name="entity">The entity to which the component belongs.</param>
+		///<returns>The tick, or 0 if the entity has no such component.</returns>
+		u32 getChangedTick(typehash component_type, Entity entity);
+
+		///<summary>
+		/// Collect all entities that have been removed after a tick.
+		///</summary>
+		///<param name="tick">The tick, usually System::last_run_tick.</param>
+		///<param name="output">The vector the entities are appended to.</param>
+		void getRemovedSince(u32 tick, std::vector<Entity>& output);
+
+		///<summary>
+		/// Get where the archetype components of an entity are stored.
+		///</summary>
+		///<param name="entity">The entity in question.</param>
+		///<returns>A pointer to the location if the entity is stored in an archetype, nullptr otherwhise.</returns>
+		EntityLocation* getLocation(Entity entity);
+
+		///<summary>
+		/// Get a component that is stored in an archetype.
+		///</summary>
+		///<param name="component_type">The type of component.</param>
+		///<param name="entity">The entity to which the component belongs.</param>
+		///<returns>A pointer to the component if found, nullptr otherwhise.</returns>
+		u8* getArchetypeComponent(typehash component_type, Entity entity);
+
+		///<summary>
+		/// Create a typed view of all entities that have every given component. The types are resolved once, when the view is created,
+		/// so a view should be created right before iterating. A type may be const to signal read-only access.
+		///</summary>
+		///<returns>The view.</returns>
+		template<typename... Ts>
+		ComponentView<Ts...> view();
+
 		///<summary>
 		/// Get a component from the newest entity.
 		///</summary>
@@ -196,11 +1204,13 @@ namespace flo {
 
 	///<summary>
 	/// An array that contains components of a set type. Only when all components are present in an entity can they appear in this array.
+	/// NOTE: Components stored in archetypes move when other entities are removed. Prefer EntityComponentSystem::view() for new code.
 	///</summary>
 	struct ComponentBundleArray {
 		std::vector<typehash> types;
 		std::vector<u8*> data;
 		std::vector<Entity> map;
+		SparseIndex sparse;
 		EntityComponentSystem* parent_ecs = nullptr;
 
 		ComponentBundleArray() = default;
@@ -218,6 +1228,13 @@ namespace flo {
 		///<param name="entity">The entity to query.</param>
 		void onAdded(Entity entity);
 
+		///<summary>
+		/// Check several entities for components, for use in System::entitiesAdded(). This must be called manually.
+		///</summary>
+		///<param name="entities">The entities to query.</param>
+		///<param name="count">The amount of entities.</param>
+		void onAdded(const Entity* entities, u32 count);
+
 		///<summary>
 		/// Remove an entity from the array. This must be called manually.
 		///</summary>
@@ -237,4 +1254,404 @@ namespace flo {
 		///<returns>The size of the array.</returns>
 		uint size();
 	};
+
+	template<typename... Ts>
+	struct ComponentView {
+		///<summary>
+		/// An archetype containing all types, along with the index of each type within it.
+		///</summary>
+		struct ArchetypeMatch {
+			Archetype* archetype;
+			u32 columns[sizeof...(Ts)];
+		};
+
+		///<summary>
+		/// A condition on the change tick of one type.
+		///</summary>
+		struct TickFilter {
+			u32 type_index;
+			u32 tick;
+			bool added;
+		};
+
+		EntityComponentSystem* parent_ecs = nullptr;
+
+		///<summary>
+		/// The hashes of all types. WARNING: READ-ONLY!
+		///</summary>
+		typehash types[sizeof...(Ts)];
+
+		///<summary>
+		/// Which types are iterated with write access, meaning they are not const. WARNING: READ-ONLY!
+		///</summary>
+		bool writable[sizeof...(Ts)];
+
+		///<summary>
+		/// The array of every type that is stored by reference, nullptr for types stored in archetypes. WARNING: READ-ONLY!
+		///</summary>
+		ComponentArray* arrays[sizeof...(Ts)];
+
+		///<summary>
+		/// All matching archetypes. Only used if every type is stored in archetypes. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<ArchetypeMatch> matches;
+
+		///<summary>
+		/// The smallest array stored by reference, whose entities are iterated. nullptr if every type is stored in archetypes. WARNING: READ-ONLY!
+		///</summary>
+		ComponentArray* driver = nullptr;
+
+		///<summary>
+		/// All conditions on change ticks. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<TickFilter> filters;
+
+		///<summary>
+		/// The tick with which writable components are marked as changed. WARNING: READ-ONLY!
+		///</summary>
+		u32 stamp = 0;
+
+		///<summary>
+		/// The tags an entity must and must not carry. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<typehash> with_tags, without_tags;
+
+		///<summary>
+		/// The combined tag filters, one bit per entity slot. Built whenever an iteration starts. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u64> tag_mask;
+
+		///<summary>
+		/// False if one of the types has never been registered, in which case the view is empty. WARNING: READ-ONLY!
+		///</summary>
+		bool valid = true;
+
+		ComponentView() = default;
+
+		///<summary>
+		/// Create a view. Use EntityComponentSystem::view() instead.
+		///</summary>
+		///<param name="ecs">The ecs to search.</param>
+		ComponentView(EntityComponentSystem& ecs) : parent_ecs(&ecs),
+		types{ uniqueCode<typename std::remove_const<Ts>::type>()... },
+		writable{ !std::is_const<Ts>::value... } {
+			stamp = ecs.change_tick;
+			for (int i = 0; i < sizeof...(Ts); ++i) {
+				arrays[i] = ecs.getComponentArray(types[i]);
+				if (!arrays[i] && !ecs.componentInfos.count(types[i])) valid = false;
+				if (arrays[i] && (!driver || arrays[i]->map.size() < driver->map.size())) driver = arrays[i];
+			}
+			if (!valid || driver) return;
+
+			for (auto iter = ecs.archetypes.begin(); iter != ecs.archetypes.end(); ++iter) {
+				ArchetypeMatch match;
+				match.archetype = iter->second;
+				bool matches_all = true;
+				for (int i = 0; i < sizeof...(Ts) && matches_all; ++i) {
+					match.columns[i] = match.archetype->findType(types[i]);
+					matches_all = match.columns[i] != invalid_index;
+				}
+				if (matches_all) matches.push_back(match);
+			}
+		}
+
+		///<summary>
+		/// Only iterate entities whose component of type T has been changed after a tick, usually System::last_run_tick.
+		/// Components stored in archetypes are tracked per chunk, so unchanged neighbours of a changed component pass as well.
+		///</summary>
+		///<param name="tick">The tick after which the component must have changed.</param>
+		///<returns>The view itself.</returns>
+		template<typename T>
+		ComponentView& changedSince(u32 tick) {
+			static_assert(hasType<T>(), "changedSince() needs a type of the view");
+			TickFilter filter = { typeIndex<T>(), tick, false };
+			filters.push_back(filter);
+			return *this;
+		}
+
+		///<summary>
+		/// Only iterate entities whose component of type T has been added after a tick, usually System::last_run_tick.
+		/// Components stored in archetypes are tracked per chunk.
+		///</summary>
+		///<param name="tick">The tick after which the component must have been added.</param>
+		///<returns>The view itself.</returns>
+		template<typename T>
+		ComponentView& addedSince(u32 tick) {
+			static_assert(hasType<T>(), "addedSince() needs a type of the view");
+			TickFilter filter = { typeIndex<T>(), tick, true };
+			filters.push_back(filter);
+			return *this;
+		}
+
+		///<summary>
+		/// Only iterate entities that carry the tag T.
+		///</summary>
+		///<returns>The view itself.</returns>
+		template<typename T>
+		ComponentView& with() {
+			with_tags.push_back(uniqueCode<T>());
+			return *this;
+		}
+
+		///<summary>
+		/// Only iterate entities that do not carry the tag T.
+		///</summary>
+		///<returns>The view itself.</returns>
+		template<typename T>
+		ComponentView& without() {
+			without_tags.push_back(uniqueCode<T>());
+			return *this;
+		}
+
+		///<summary>
+		/// Call a function for every matching entity. The function is called as 'function(Entity, Ts&...)'.
+		/// Non-const components are marked as changed. Entities must not be added or removed during the iteration.
+		///</summary>
+		///<param name="function">The function to call.</param>
+		template<typename F>
+		void each(F function) {
+			eachChunk([&function](u32 count, const Entity* entities, Ts*... components) {
+				for (u32 i = 0; i < count; ++i) function(entities[i], components[i]...);
+			});
+		}
+
+		///<summary>
+		/// Call a function for every tightly packed run of matching entities. The function is called as 'function(u32 count, const Entity*, Ts*...)'.
+		/// Components stored in archetypes are passed one chunk at a time, or one run of rows passing the tag filters at a time, components stored by reference one entity at a time.
+		/// Non-const components are marked as changed, unless the function returns false to signal that it has not touched the run.
+		/// Entities must not be added or removed during the iteration.
+		///</summary>
+		///<param name="function">The function to call.</param>
+		template<typename F>
+		void eachChunk(F function) {
+			iterate(function, true);
+		}
+
+		///<summary>
+		/// Like each(), but only for the entities that are due in the current frame according to their simulation level of detail.
+		/// The function is called as 'function(Entity, float dt, Ts&...)', where 'dt' covers all frames since the entity was last due.
+		///</summary>
+		///<param name="function">The function to call.</param>
+		template<typename F>
+		void eachScheduled(F function) {
+			const EntityComponentSystem* ecs = parent_ecs;
+			eachChunk([&function, ecs](u32 count, const Entity* entities, Ts*... components) {
+				float dt;
+				bool ran = false;
+				for (u32 i = 0; i < count; ++i) {
+					if (!ecs->isScheduled(entities[i], dt)) continue;
+					function(entities[i], dt, components[i]...);
+					ran = true;
+				}
+				//chunks whose entities are all skipped this frame are not marked as changed
+				return ran;
+			});
+		}
+
+		///<summary>
+		/// Like each(), but the entities are split into batches that run on the thread pool of the ecs.
+		/// The function must therefore be safe to call from several threads at once.
+		///</summary>
+		///<param name="function">The function to call.</param>
+		template<typename F>
+		void eachParallel(F function) {
+			eachChunkParallel([&function](u32 count, const Entity* entities, Ts*... components) {
+				for (u32 i = 0; i < count; ++i) function(entities[i], components[i]...);
+			});
+		}
+
+		///<summary>
+		/// Like eachChunk(), but every chunk (or batch of entities stored by reference) runs as a task on the thread pool of the ecs.
+		/// The function must therefore be safe to call from several threads at once.
+		///</summary>
+		///<param name="function">The function to call.</param>
+		template<typename F>
+		void eachChunkParallel(F function) {
+			if (!valid || !prepareTags()) return;
+			if (!parent_ecs->thread_pool) {
+				iterate(function, true);
+				return;
+			}
+			if (driver) {
+				//the ticks of archetype chunks are shared by the entities of several batches, so every batch collects them and they are set afterwards
+				std::vector<std::vector<u32*>> chunk_ticks((driver->map.size() + reference_batch_size - 1) / reference_batch_size);
+				parent_ecs->thread_pool->parallelFor(driver->map.size(), reference_batch_size, [&](u32 begin, u32 end) {
+					eachReference(function, begin, end, true, std::index_sequence_for<Ts...>(), &chunk_ticks[begin / reference_batch_size]);
+				});
+				for (int b = 0; b < chunk_ticks.size(); ++b) {
+					for (int t = 0; t < chunk_ticks[b].size(); ++t) *chunk_ticks[b][t] = stamp;
+				}
+				return;
+			}
+
+			std::vector<std::pair<u32, u32>> jobs;
+			for (u32 m = 0; m < matches.size(); ++m) {
+				for (u32 c = 0; c < matches[m].archetype->chunks.size(); ++c) jobs.push_back(std::make_pair(m, c));
+			}
+			parent_ecs->thread_pool->parallelFor(jobs.size(), 1, [&](u32 begin, u32 end) {
+				for (u32 j = begin; j < end; ++j) eachArchetypeChunk(function, matches[jobs[j].first], jobs[j].second, true, std::index_sequence_for<Ts...>());
+			});
+		}
+
+		///<summary>
+		/// Count all matching entities. This does not mark anything as changed.
+		///</summary>
+		///<returns>The amount of entities.</returns>
+		u32 size() {
+			u32 result = 0;
+			auto count_function = [&result](u32 count, const Entity*, Ts*...) { result += count; };
+			iterate(count_function, false);
+			return result;
+		}
+
+	private:
+		///<summary>
+		/// The amount of entities stored by reference that are handled by one task in eachChunkParallel().
+		///</summary>
+		static const u32 reference_batch_size = 256;
+
+		template<typename T>
+		static constexpr bool hasType() {
+			const bool same[] = { std::is_same<typename std::remove_const<T>::type, typename std::remove_const<Ts>::type>::value... };
+			for (u32 i = 0; i < sizeof...(Ts); ++i) {
+				if (same[i]) return true;
+			}
+			return false;
+		}
+
+		///<summary>
+		/// Call an iteration function. It may return a bool that tells whether it has touched the components; void functions always have.
+		///</summary>
+		template<typename F, typename... Args>
+		static bool invokeFunction(F& function, Args&&... args) {
+			return invokeFunction(std::is_void<decltype(function(std::forward<Args>(args)...))>(), function, std::forward<Args>(args)...);
+		}
+
+		template<typename F, typename... Args>
+		static bool invokeFunction(std::true_type, F& function, Args&&... args) {
+			function(std::forward<Args>(args)...);
+			return true;
+		}
+
+		template<typename F, typename... Args>
+		static bool invokeFunction(std::false_type, F& function, Args&&... args) {
+			return function(std::forward<Args>(args)...);
+		}
+
+		template<typename T>
+		static u32 typeIndex() {
+			const bool same[] = { std::is_same<typename std::remove_const<T>::type, typename std::remove_const<Ts>::type>::value... };
+			for (u32 i = 0; i < sizeof...(Ts); ++i) {
+				if (same[i]) return i;
+			}
+			return invalid_index;
+		}
+
+		///<summary>
+		/// Build the tag mask if there are tag filters.
+		///</summary>
+		///<returns>False if no entity can pass the tag filters.</returns>
+		bool prepareTags() {
+			if (with_tags.empty() && without_tags.empty()) return true;
+			return parent_ecs->buildTagMask(with_tags, without_tags, tag_mask);
+		}
+
+		bool passesTags(Entity entity) const {
+			if (with_tags.empty() && without_tags.empty()) return true;
+			const u32 index = entityIndex(entity);
+			return index / 64 < tag_mask.size() && (tag_mask[index / 64] >> (index % 64) & 1);
+		}
+
+		template<typename F>
+		void iterate(F& function, bool mark) {
+			if (!valid || !prepareTags()) return;
+			if (driver) eachReference(function, 0, driver->map.size(), mark, std::index_sequence_for<Ts...>());
+			else {
+				for (int m = 0; m < matches.size(); ++m) {
+					for (u32 c = 0; c < matches[m].archetype->chunks.size(); ++c) {
+						eachArchetypeChunk(function, matches[m], c, mark, std::index_sequence_for<Ts...>());
+					}
+				}
+			}
+		}
+
+		template<typename F, size_t... I>
+		void eachArchetypeChunk(F& function, const ArchetypeMatch& match, u32 c, bool mark, std::index_sequence<I...>) {
+			Archetype* archetype = match.archetype;
+			ArchetypeChunk& chunk = archetype->chunks[c];
+			for (int f = 0; f < filters.size(); ++f) {
+				const u32 tick = filters[f].added ? chunk.added_tick : chunk.changed_ticks[match.columns[filters[f].type_index]];
+				if (tick <= filters[f].tick) return;
+			}
+			const Entity* entities = archetype->getEntities(c);
+			bool passed = false;
+			if (with_tags.empty() && without_tags.empty()) {
+				passed = invokeFunction(function, chunk.count, entities, (Ts*)archetype->getColumn(c, match.columns[I])...);
+			}
+			else {
+				for (u32 begin = 0, end = 0; begin < chunk.count; begin = end) {
+					while (begin < chunk.count && !passesTags(entities[begin])) ++begin;
+					for (end = begin; end < chunk.count && passesTags(entities[end]); ++end);
+					if (end == begin) continue;
+					if (invokeFunction(function, end - begin, entities + begin, (Ts*)archetype->getColumn(c, match.columns[I]) + begin...)) passed = true;
+				}
+			}
+			for (u32 i = 0; i < sizeof...(Ts) && mark && passed; ++i) {
+				if (writable[i]) chunk.changed_ticks[match.columns[i]] = stamp;
+			}
+		}
+
+		///<summary>
+		/// Iterate a range of the entities of the driving component array. If 'chunk_ticks' is given, the changed ticks of components
+		/// stored in archetypes are collected into it instead of being set, as other threads may share their chunks.
+		///</summary>
+		template<typename F, size_t... I>
+		void eachReference(F& function, u32 begin, u32 end, bool mark, std::index_sequence<I...>, std::vector<u32*>* chunk_ticks = nullptr) {
+			u8* components[sizeof...(Ts)];
+			u32* changed_ticks[sizeof...(Ts)];
+			u32 added_ticks[sizeof...(Ts)];
+			bool in_chunk[sizeof...(Ts)];
+			for (u32 e = begin; e < end; ++e) {
+				const Entity entity = driver->map[e];
+				bool found = passesTags(entity);
+				for (u32 i = 0; i < sizeof...(Ts) && found; ++i) {
+					if (arrays[i]) {
+						const u32 index = arrays[i] == driver ? e : arrays[i]->findEntity(entity);
+						found = index != invalid_index;
+						if (!found) break;
+						components[i] = arrays[i]->data[index];
+						changed_ticks[i] = &arrays[i]->changed_ticks[index];
+						added_ticks[i] = arrays[i]->added_ticks[index];
+						in_chunk[i] = false;
+						continue;
+					}
+					EntityLocation* location = parent_ecs->getLocation(entity);
+					const u32 column = location ? location->archetype->findType(types[i]) : invalid_index;
+					found = column != invalid_index;
+					if (!found) break;
+					ArchetypeChunk& chunk = location->archetype->chunks[location->chunk];
+					components[i] = location->archetype->getColumn(location->chunk, column) + location->row * location->archetype->infos[column].size;
+					changed_ticks[i] = &chunk.changed_ticks[column];
+					added_ticks[i] = chunk.added_tick;
+					in_chunk[i] = true;
+				}
+				for (int f = 0; f < filters.size() && found; ++f) {
+					const u32 i = filters[f].type_index;
+					found = (filters[f].added ? added_ticks[i] : *changed_ticks[i]) > filters[f].tick;
+				}
+				if (!found || !invokeFunction(function, 1u, &driver->map[e], (Ts*)components[I]...)) continue;
+				for (u32 i = 0; i < sizeof...(Ts) && mark; ++i) {
+					if (!writable[i]) continue;
+					if (!chunk_ticks || !in_chunk[i]) *changed_ticks[i] = stamp;
+					//neighbouring entities mostly share a chunk, so repeats are skipped
+					else if (chunk_ticks->empty() || chunk_ticks->back() != changed_ticks[i]) chunk_ticks->push_back(changed_ticks[i]);
+				}
+			}
+		}
+	};
+
+	template<typename... Ts>
+	ComponentView<Ts...> EntityComponentSystem::view() {
+		return ComponentView<Ts...>(*this);
+	}
 }
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "Hierarchy.h"
+
+#include <algorithm>
+
+namespace flo {
+	void TransformHierarchySystem::onRegistered() {
+		declareReads<TransformComponent>();
+		declareWrites<TransformHierarchySystem>();
+	}
+
+	void TransformHierarchySystem::entityAdded(Entity entity) {
+	}
+
+	void TransformHierarchySystem::entityDestroyed(Entity entity) {
+		entitiesDestroyed(&entity, 1);
+	}
+
+	void TransformHierarchySystem::entitiesDestroyed(const Entity* destroyed, u32 count) {
+		for (u32 i = 0; i < count; ++i) {
+			const u32 node = findNode(destroyed[i]);
+			if (node == invalid_index) continue;
+			//the node is dropped and its children become roots on the next rebuild
+			entities[node] = 0;
+			nodes.erase(destroyed[i]);
+			order_changed = true;
+		}
+	}
+
+	void TransformHierarchySystem::update(float dt) {
+		if (order_changed) rebuildOrder();
+
+		const typehash transform_type = uniqueCode<TransformComponent>();
+		for (u32 i = 0; i < entities.size(); ++i) {
+			const u32 parent = parents[i];
+			const bool changed = dirty[i] || (parent != invalid_index && dirty[parent]) || parent_ecs->getChangedTick(transform_type, entities[i]) > last_run_tick;
+			dirty[i] = changed;
+			if (!changed) continue;
+
+			TransformComponent* transform = (TransformComponent*)parent_ecs->getComponent(transform_type, entities[i]);
+			const glm::mat3 local = transform ? transform->getMatrix() : glm::mat3(1.);
+			world_matrices[i] = parent == invalid_index ? local : world_matrices[parent] * local;
+		}
+		std::fill(dirty.begin(), dirty.end(), 0);
+	}
+
+	bool TransformHierarchySystem::setParent(Entity child, Entity parent) {
+		if (child == parent) return false;
+		//a removed entity whose removal has already been announced would never be dropped from the hierarchy
+		if (!parent_ecs->isAlive(child) || !parent_ecs->isAlive(parent)) return false;
+		for (u32 node = findNode(parent); node != invalid_index; node = parents[node]) {
+			if (entities[node] == child) return false;
+		}
+		u32 parent_node = findNode(parent);
+		if (parent_node == invalid_index) parent_node = addNode(parent);
+		u32 child_node = findNode(child);
+		if (child_node == invalid_index) child_node = addNode(child);
+
+		parents[child_node] = parent_node;
+		dirty[child_node] = 1;
+		//a parent has to precede its children
+		if (parent_node > child_node) order_changed = true;
+		return true;
+	}
+
+	void TransformHierarchySystem::removeParent(Entity child) {
+		const u32 node = findNode(child);
+		if (node == invalid_index || parents[node] == invalid_index) return;
+		parents[node] = invalid_index;
+		dirty[node] = 1;
+	}
+
+	Entity TransformHierarchySystem::getParent(Entity child) {
+		const u32 node = findNode(child);
+		if (node == invalid_index || parents[node] == invalid_index) return 0;
+		return entities[parents[node]];
+	}
+
+	const glm::mat3* TransformHierarchySystem::getWorldMatrix(Entity entity) {
+		const u32 node = findNode(entity);
+		if (node == invalid_index) return nullptr;
+		return &world_matrices[node];
+	}
+
+	void TransformHierarchySystem::markDirty(Entity entity) {
+		const u32 node = findNode(entity);
+		if (node != invalid_index) dirty[node] = 1;
+	}
+
+	u32 TransformHierarchySystem::findNode(Entity entity) {
+		const u32 node = nodes.get(entity);
+		if (node == invalid_index || node >= entities.size() || entities[node] != entity) return invalid_index;
+		return node;
+	}
+
+	u32 TransformHierarchySystem::addNode(Entity entity) {
+		const u32 node = entities.size();
+		entities.push_back(entity);
+		parents.push_back(invalid_index);
+		world_matrices.push_back(glm::mat3(1.));
+		dirty.push_back(1);
+		nodes.set(entity, node);
+		return node;
+	}
+
+	void TransformHierarchySystem::rebuildOrder() {
+		const u32 node_count = entities.size();
+		std::vector<u32> depths(node_count, invalid_index);
+		std::vector<u32> chain;
+		for (u32 i = 0; i < node_count; ++i) {
+			if (!entities[i] || depths[i] != invalid_index) continue;
+			//walk up until a node of known depth or a root is found, then assign the depths on the way back
+			u32 node = i;
+			while (true) {
+				if (parents[node] != invalid_index && !entities[parents[node]]) {
+					parents[node] = invalid_index;
+					dirty[node] = 1;
+				}
+				chain.push_back(node);
+				if (parents[node] == invalid_index || depths[parents[node]] != invalid_index) break;
+				node = parents[node];
+			}
+			u32 depth = parents[node] == invalid_index ? 0 : depths[parents[node]] + 1;
+			for (u32 c = chain.size(); c > 0; --c) depths[chain[c - 1]] = depth++;
+			chain.clear();
+		}
+
+		std::vector<u32> order;
+		for (u32 i = 0; i < node_count; ++i) {
+			if (entities[i]) order.push_back(i);
+		}
+		std::stable_sort(order.begin(), order.end(), [&depths](u32 a, u32 b) { return depths[a] < depths[b]; });
+
+		std::vector<u32> new_index(node_count, invalid_index);
+		for (u32 i = 0; i < order.size(); ++i) new_index[order[i]] = i;
+
+		std::vector<Entity> sorted_entities(order.size());
+		std::vector<u32> sorted_parents(order.size());
+		std::vector<glm::mat3> sorted_matrices(order.size());
+		std::vector<u8> sorted_dirty(order.size());
+		for (u32 i = 0; i < order.size(); ++i) {
+			const u32 old = order[i];
+			sorted_entities[i] = entities[old];
+			sorted_parents[i] = parents[old] == invalid_index ? invalid_index : new_index[parents[old]];
+			sorted_matrices[i] = world_matrices[old];
+			sorted_dirty[i] = dirty[old];
+			nodes.set(entities[old], i);
+		}
+		entities.swap(sorted_entities);
+		parents.swap(sorted_parents);
+		world_matrices.swap(sorted_matrices);
+		dirty.swap(sorted_dirty);
+		order_changed = false;
+	}
+}
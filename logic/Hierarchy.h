@@ -0,0 +1,101 @@
+#pragma once
+#include "ECS.h"
+#include "Matrices.h"
+
+namespace flo {
+	///<summary>
+	/// A system maintaining parent/child relations between entities and the world matrix of every entity in a hierarchy.
+	/// The world matrix of an entity is the world matrix of its parent times the matrix of its own TransformComponent.
+	/// The nodes are stored sorted by depth, so every parent precedes its children and one linear pass updates all matrices.
+	/// Only nodes whose transform or whose ancestors' transforms have changed since the last update are recomputed.
+	/// Systems that read world matrices should declare reads of TransformHierarchySystem itself, so that they never run alongside its update.
+	///</summary>
+	struct TransformHierarchySystem : public flo::System {
+		///<summary>
+		/// The entity of every node, sorted by depth. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<Entity> entities;
+
+		///<summary>
+		/// The index of every node's parent node, invalid_index for roots. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u32> parents;
+
+		///<summary>
+		/// The cached world matrix of every node. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<glm::mat3> world_matrices;
+
+		///<summary>
+		/// Whether the world matrix of every node has to be recomputed. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u8> dirty;
+
+		///<summary>
+		/// The node of every entity. WARNING: READ-ONLY!
+		///</summary>
+		SparseIndex nodes;
+
+		///<summary>
+		/// Whether nodes have been added, removed or reparented, so that the order has to be rebuilt. WARNING: READ-ONLY!
+		///</summary>
+		bool order_changed = false;
+
+		TransformHierarchySystem() = default;
+
+		virtual void onRegistered() override;
+
+		virtual void entityAdded(Entity entity) override;
+
+		virtual void entityDestroyed(Entity entity) override;
+
+		virtual void entitiesDestroyed(const Entity* entities, u32 count) override;
+
+		virtual void update(float dt) override;
+
+		///<summary>
+		/// Attach an entity to a parent. Both become part of the hierarchy if they are not yet.
+		///</summary>
+		///<param name="child">The entity to attach.</param>
+		///<param name="parent">The new parent.</param>
+		///<returns>False if either entity has been removed or the parent is a descendant of the child (or the child itself), in which case nothing changes.</returns>
+		bool setParent(Entity child, Entity parent);
+
+		///<summary>
+		/// Detach an entity from its parent, making it a root.
+		///</summary>
+		///<param name="child">The entity to detach.</param>
+		void removeParent(Entity child);
+
+		///<summary>
+		/// Get the parent of an entity.
+		///</summary>
+		///<param name="child">The entity in question.</param>
+		///<returns>The parent, or 0 if the entity has none.</returns>
+		Entity getParent(Entity child);
+
+		///<summary>
+		/// Get the world matrix of an entity as of the last update.
+		///</summary>
+		///<param name="entity">The entity in question.</param>
+		///<returns>A pointer to the matrix if the entity is part of the hierarchy, nullptr otherwhise.</returns>
+		const glm::mat3* getWorldMatrix(Entity entity);
+
+		///<summary>
+		/// Force the world matrix of an entity and its descendants to be recomputed on the next update.
+		/// This is only needed if the transform has been changed without marking it as changed in the ecs.
+		///</summary>
+		///<param name="entity">The entity in question.</param>
+		void markDirty(Entity entity);
+
+	private:
+		u32 findNode(Entity entity);
+
+		u32 addNode(Entity entity);
+
+		///<summary>
+		/// Drop removed nodes and sort the rest by depth, keeping the previous order among nodes of equal depth.
+		///</summary>
+		void rebuildOrder();
+	};
+}
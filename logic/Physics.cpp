@@ -1,11 +1,14 @@
 #include "Physics.h"
+#include "SimdMath.h"
+#include "Tilemap.h"
 
 #include <iostream>
+#include <algorithm>
+#include <limits>
 
 namespace flo {
 	Collider::Collider(std::vector<glm::vec2> vertices) :
 	vertices(vertices) {
-		utility_vertices.resize(vertices.size());
 	}
 
 	float cross2D(glm::vec2 a, glm::vec2 b) {
@@ -30,30 +33,101 @@ namespace flo {
 		return moi / (divisor * 6.);
 	}
 
-	Collision Collider::collide(Collider& other, glm::vec2 p0) {
-		Collision result;
-		for (int i = 0; i < utility_vertices.size(); ++i) {
-			glm::vec2 d0 = utility_vertices[i] - p0;
-			glm::vec2 n0 = skew(d0);
-			for (int j = 0; j < other.utility_vertices.size(); ++j) {
-				glm::vec2 p1 = other.utility_vertices[j];
-				glm::vec2 d1 = other.utility_vertices[(j + 1) % other.utility_vertices.size()] - p1;
-				glm::vec2 n1 = skew(d1);
-				float a0 = glm::dot(p1 - p0, n0);
-				float b0 = glm::dot(p1 - p0 + d1, n0);
-				float a1 = glm::dot(p0 - p1, n1);
-				float b1 = glm::dot(p0 - p1 + d0, n1);
-				float f0 = a0 / (a0 - b0);
-				float f1 = a1 / (a1 - b1);
-				if (f0 >= 0.0f && f0 < 1.0f && f1 >= 0.0f && f1 < 1.0f) {
-					float msqr = glm::dot(n1, n1);
-					result.clip_vec = n1 * b1 / msqr;
-					result.point = p0 + d0;
-					return result;
-				}
+	float Manifold::getDepth() const {
+		return point_count == 2 ? glm::max(depths[0], depths[1]) : depths[0];
+	}
+
+	void computeNormals(const glm::vec2* vertices, u32 count, glm::vec2* normals) {
+		float area = 0;
+		for (u32 i = 0; i < count; ++i) area += cross2D(vertices[i], vertices[(i + 1) % count]);
+		//skew() points outwards for counter-clockwise polygons
+		const float sign = area > 0 ? 1.f : -1.f;
+		for (u32 i = 0; i < count; ++i) {
+			const glm::vec2 edge = vertices[(i + 1) % count] - vertices[i];
+			const float length = glm::length(edge);
+			normals[i] = length > 0 ? skew(edge) * (sign / length) : glm::vec2(0.);
+		}
+	}
+
+	///<summary>
+	/// Find the edge of polygon a along whose normal b is separated the most.
+	///</summary>
+	float findMaxSeparation(const glm::vec2* vertices_a, const glm::vec2* normals_a, u32 count_a, const glm::vec2* vertices_b, u32 count_b, u32& edge) {
+		float max_separation = -std::numeric_limits<float>::max();
+		for (u32 i = 0; i < count_a; ++i) {
+			float separation = std::numeric_limits<float>::max();
+			for (u32 j = 0; j < count_b; ++j) separation = glm::min(separation, glm::dot(normals_a[i], vertices_b[j] - vertices_a[i]));
+			if (separation > max_separation) {
+				max_separation = separation;
+				edge = i;
 			}
 		}
-		return result;
+		return max_separation;
+	}
+
+	///<summary>
+	/// Keep the part of a segment behind a plane.
+	///</summary>
+	u32 clipSegment(glm::vec2* points, glm::vec2 normal, float offset) {
+		const float d0 = glm::dot(normal, points[0]) - offset;
+		const float d1 = glm::dot(normal, points[1]) - offset;
+		if (d0 > 0 && d1 > 0) return 0;
+		if (d0 > 0) points[0] += (points[1] - points[0]) * (d0 / (d0 - d1));
+		else if (d1 > 0) points[1] += (points[0] - points[1]) * (d1 / (d1 - d0));
+		return 2;
+	}
+
+	bool collidePolygons(const glm::vec2* vertices_a, const glm::vec2* normals_a, u32 count_a, const glm::vec2* vertices_b, const glm::vec2* normals_b, u32 count_b, Manifold& manifold, float margin) {
+		manifold.point_count = 0;
+		if (count_a < 2 || count_b < 2) return false;
+
+		u32 edge_a = 0, edge_b = 0;
+		const float separation_a = findMaxSeparation(vertices_a, normals_a, count_a, vertices_b, count_b, edge_a);
+		if (separation_a > margin) return false;
+		const float separation_b = findMaxSeparation(vertices_b, normals_b, count_b, vertices_a, count_a, edge_b);
+		if (separation_b > margin) return false;
+
+		//prefer a's faces, so that the reference face does not flip between steps for nearly equal separations
+		const bool flip = separation_b > separation_a + 5e-4f;
+		const glm::vec2* reference = flip ? vertices_b : vertices_a;
+		const glm::vec2* incident = flip ? vertices_a : vertices_b;
+		const glm::vec2* incident_normals = flip ? normals_a : normals_b;
+		const u32 reference_count = flip ? count_b : count_a, incident_count = flip ? count_a : count_b;
+		const u32 reference_edge = flip ? edge_b : edge_a;
+		const glm::vec2 normal = flip ? normals_b[edge_b] : normals_a[edge_a];
+
+		//the incident edge is the one most opposed to the reference face
+		u32 incident_edge = 0;
+		float min_dot = std::numeric_limits<float>::max();
+		for (u32 i = 0; i < incident_count; ++i) {
+			const float d = glm::dot(normal, incident_normals[i]);
+			if (d < min_dot) {
+				min_dot = d;
+				incident_edge = i;
+			}
+		}
+
+		const glm::vec2 r0 = reference[reference_edge], r1 = reference[(reference_edge + 1) % reference_count];
+		const glm::vec2 edge = r1 - r0;
+		const float length = glm::length(edge);
+		if (length == 0) return false;
+		const glm::vec2 tangent = edge / length;
+
+		glm::vec2 points[2] = { incident[incident_edge], incident[(incident_edge + 1) % incident_count] };
+		if (!clipSegment(points, -tangent, -glm::dot(tangent, r0))) return false;
+		if (!clipSegment(points, tangent, glm::dot(tangent, r1))) return false;
+
+		const float face_offset = glm::dot(normal, r0);
+		for (int i = 0; i < 2; ++i) {
+			const float separation = glm::dot(normal, points[i]) - face_offset;
+			if (separation > margin) continue;
+			manifold.points[manifold.point_count] = points[i];
+			manifold.depths[manifold.point_count] = -separation;
+			manifold.features[manifold.point_count] = (flip ? 0x80000000u : 0u) | reference_edge << 16 | (incident_edge + i) % incident_count;
+			++manifold.point_count;
+		}
+		manifold.normal = flip ? -normal : normal;
+		return manifold.point_count > 0;
 	}
 
 	float cross2(glm::vec2 a, glm::vec2 b) {
@@ -65,93 +139,872 @@ namespace flo {
 
 	}
 
-	void PhysicsComponent::assignComponents(Collider& _collider, TransformComponent& _transform) {
-		collider = _collider;
-		transform = &_transform;
+	void PhysicsComponent::assignComponents(u32 _shape, const TransformComponent& _transform) {
+		shape = _shape;
+		previous_pos = _transform.pos;
+		previous_angle = _transform.angle;
 	}
 
-	void PhysicsComponent::applyForce(glm::vec2 pos, glm::vec2 f) {
-		torque += cross2(pos - transform->pos, f);
+	void PhysicsComponent::applyForce(glm::vec2 center, glm::vec2 pos, glm::vec2 f) {
+		torque += cross2(pos - center, f);
 		force += f;
+		wake();
 	}
 
-	void PhysicsComponent::runStep(float dt, flo::TransformComponent& transform) {
-		glm::vec2 impulse = force * dt;
-		float delta_omega = torque / moment_of_inertia * dt;
-		angular_velocity += delta_omega;
-		velocity += force * dt;
+	void PhysicsComponent::wake() {
+		sleeping = false;
+		sleep_time = 0;
+	}
 
-		transform.pos += velocity * dt;
-		transform.angle += angular_velocity * dt;
-		transform.angle = glm::mod(transform.angle, 3.141592653589f * 2.f);
+	void BodyStore::resize(u32 count) {
+		std::vector<float>* arrays[] = { &pos_x, &pos_y, &angle, &vel_x, &vel_y, &angular_velocity, &force_x, &force_y, &torque, &inverse_mass, &inverse_inertia, &sines, &cosines };
+		for (std::vector<float>* array : arrays) array->resize(count);
+		size = count;
+	}
 
-		torque = 0;
-		force = glm::vec2(0.);
+	bool BodyStore::isDynamic(u32 body) const {
+		return inverse_mass[body] > 0 || inverse_inertia[body] > 0;
 	}
 
-	void PhysicsComponent::handle_collision(PhysicsComponent& other, float dt) {
-		glm::vec2 s0 = transform->size * 2.83f;
-		glm::vec2 s1 = other.transform->size * 2.83f;
-		glm::vec2 p0 = transform->pos - s0 * 0.5f;
-		glm::vec2 p1 = other.transform->pos - s1 * 0.5f;
-		if (p0.x + s0.x < p1.x || p0.x > p1.x + s1.x || p0.y + s0.y < p1.y || p0.y > p1.y + s1.y) return;
-		
-		collectVertices();
-		other.collectVertices();
+	void BodyStore::integrateVelocities(float dt, u32 count, glm::vec2 gravity) {
+		u32 i = 0;
+#ifdef FLO_AVX
+		{
+			const __m256 step = _mm256_set1_ps(dt), zero = _mm256_setzero_ps();
+			const __m256 gravity_x = _mm256_set1_ps(gravity.x * dt), gravity_y = _mm256_set1_ps(gravity.y * dt);
+			for (; i + 8 <= count; i += 8) {
+				const __m256 inverse_mass = _mm256_loadu_ps(&this->inverse_mass[i]);
+				const __m256 inverse_mass_step = _mm256_mul_ps(inverse_mass, step);
+				//gravity only accelerates bodies with a mass
+				const __m256 has_mass = _mm256_cmp_ps(inverse_mass, zero, _CMP_GT_OQ);
+				const __m256 vx = _mm256_add_ps(_mm256_loadu_ps(&vel_x[i]), _mm256_and_ps(has_mass, gravity_x));
+				const __m256 vy = _mm256_add_ps(_mm256_loadu_ps(&vel_y[i]), _mm256_and_ps(has_mass, gravity_y));
+				_mm256_storeu_ps(&vel_x[i], _mm256_add_ps(vx, _mm256_mul_ps(_mm256_loadu_ps(&force_x[i]), inverse_mass_step)));
+				_mm256_storeu_ps(&vel_y[i], _mm256_add_ps(vy, _mm256_mul_ps(_mm256_loadu_ps(&force_y[i]), inverse_mass_step)));
+				_mm256_storeu_ps(&angular_velocity[i], _mm256_add_ps(_mm256_loadu_ps(&angular_velocity[i]), _mm256_mul_ps(_mm256_loadu_ps(&torque[i]), _mm256_mul_ps(_mm256_loadu_ps(&inverse_inertia[i]), step))));
+			}
+		}
+#endif
+#ifdef FLO_SSE2
+		{
+			const __m128 step = _mm_set1_ps(dt), zero = _mm_setzero_ps();
+			const __m128 gravity_x = _mm_set1_ps(gravity.x * dt), gravity_y = _mm_set1_ps(gravity.y * dt);
+			for (; i + 4 <= count; i += 4) {
+				const __m128 inverse_mass = _mm_loadu_ps(&this->inverse_mass[i]);
+				const __m128 inverse_mass_step = _mm_mul_ps(inverse_mass, step);
+				const __m128 has_mass = _mm_cmpgt_ps(inverse_mass, zero);
+				const __m128 vx = _mm_add_ps(_mm_loadu_ps(&vel_x[i]), _mm_and_ps(has_mass, gravity_x));
+				const __m128 vy = _mm_add_ps(_mm_loadu_ps(&vel_y[i]), _mm_and_ps(has_mass, gravity_y));
+				_mm_storeu_ps(&vel_x[i], _mm_add_ps(vx, _mm_mul_ps(_mm_loadu_ps(&force_x[i]), inverse_mass_step)));
+				_mm_storeu_ps(&vel_y[i], _mm_add_ps(vy, _mm_mul_ps(_mm_loadu_ps(&force_y[i]), inverse_mass_step)));
+				_mm_storeu_ps(&angular_velocity[i], _mm_add_ps(_mm_loadu_ps(&angular_velocity[i]), _mm_mul_ps(_mm_loadu_ps(&torque[i]), _mm_mul_ps(_mm_loadu_ps(&inverse_inertia[i]), step))));
+			}
+		}
+#endif
+		for (; i < count; ++i) {
+			const float inverse_mass_step = inverse_mass[i] * dt;
+			if (inverse_mass[i] > 0) {
+				vel_x[i] += gravity.x * dt;
+				vel_y[i] += gravity.y * dt;
+			}
+			vel_x[i] += force_x[i] * inverse_mass_step;
+			vel_y[i] += force_y[i] * inverse_mass_step;
+			angular_velocity[i] += torque[i] * (inverse_inertia[i] * dt);
+		}
+	}
+
+	void BodyStore::integratePositions(float dt, u32 count) {
+		const float two_pi = 3.141592653589f * 2.f;
+		u32 i = 0;
+#ifdef FLO_AVX
+		{
+			const __m256 step = _mm256_set1_ps(dt), period = _mm256_set1_ps(two_pi);
+			for (; i + 8 <= count; i += 8) {
+				_mm256_storeu_ps(&pos_x[i], _mm256_add_ps(_mm256_loadu_ps(&pos_x[i]), _mm256_mul_ps(_mm256_loadu_ps(&vel_x[i]), step)));
+				_mm256_storeu_ps(&pos_y[i], _mm256_add_ps(_mm256_loadu_ps(&pos_y[i]), _mm256_mul_ps(_mm256_loadu_ps(&vel_y[i]), step)));
+				//wrap the angle into [0, 2pi) like glm::mod()
+				const __m256 a = _mm256_add_ps(_mm256_loadu_ps(&angle[i]), _mm256_mul_ps(_mm256_loadu_ps(&angular_velocity[i]), step));
+				_mm256_storeu_ps(&angle[i], _mm256_sub_ps(a, _mm256_mul_ps(period, _mm256_floor_ps(_mm256_div_ps(a, period)))));
+			}
+		}
+#endif
+#ifdef FLO_SSE2
+		{
+			const __m128 step = _mm_set1_ps(dt), period = _mm_set1_ps(two_pi), one = _mm_set1_ps(1.f);
+			for (; i + 4 <= count; i += 4) {
+				_mm_storeu_ps(&pos_x[i], _mm_add_ps(_mm_loadu_ps(&pos_x[i]), _mm_mul_ps(_mm_loadu_ps(&vel_x[i]), step)));
+				_mm_storeu_ps(&pos_y[i], _mm_add_ps(_mm_loadu_ps(&pos_y[i]), _mm_mul_ps(_mm_loadu_ps(&vel_y[i]), step)));
+				//SSE2 has no floor, so truncate and correct the negative values
+				const __m128 a = _mm_add_ps(_mm_loadu_ps(&angle[i]), _mm_mul_ps(_mm_loadu_ps(&angular_velocity[i]), step));
+				const __m128 quotient = _mm_div_ps(a, period);
+				__m128 floored = _mm_cvtepi32_ps(_mm_cvttps_epi32(quotient));
+				floored = _mm_sub_ps(floored, _mm_and_ps(_mm_cmpgt_ps(floored, quotient), one));
+				_mm_storeu_ps(&angle[i], _mm_sub_ps(a, _mm_mul_ps(period, floored)));
+			}
+		}
+#endif
+		for (; i < count; ++i) {
+			pos_x[i] += vel_x[i] * dt;
+			pos_y[i] += vel_y[i] * dt;
+			angle[i] = glm::mod(angle[i] + angular_velocity[i] * dt, two_pi);
+		}
+	}
 
-		Collision collision = collider.collide(other.collider, transform->pos);
-		if (collision.clip_vec == glm::vec2(0.)) collision = other.collider.collide(collider, other.transform->pos);
-		if (collision.clip_vec != glm::vec2(0.)) {
-			transform->pos -= collision.clip_vec;
-			glm::vec2 impulse0 = impulse_vector(collision.point);
-			glm::vec2 impulse1 = other.impulse_vector(collision.point);
-			glm::vec2 force = (impulse1 + impulse0) / dt;
-			applyForce(collision.point, -force);
-			other.applyForce(collision.point, force);
+	bool containsPoint(const glm::vec2* polygon, u32 count, glm::vec2 point) {
+		bool inside = false;
+		for (u32 i = 0, j = count - 1; i < count; j = i++) {
+			const glm::vec2 a = polygon[i], b = polygon[j];
+			if ((a.y > point.y) != (b.y > point.y) && point.x < (b.x - a.x) * (point.y - a.y) / (b.y - a.y) + a.x) inside = !inside;
 		}
+		return inside;
 	}
 
-	glm::vec2 PhysicsComponent::impulse_vector(glm::vec2 pos) {
-		glm::vec2 r = pos - transform->pos;
-		float rsqr = glm::dot(r, r);
-		return velocity * mass/* + moment_of_inertia * angular_velocity * r / rsqr*/;
+	float raycastPolygon(const glm::vec2* polygon, u32 count, glm::vec2 origin, glm::vec2 direction, float max_distance) {
+		if (!count) return -1;
+		if (containsPoint(polygon, count, origin)) return 0;
+		float result = -1;
+		for (u32 i = 0; i < count; ++i) {
+			const glm::vec2 a = polygon[i];
+			const glm::vec2 edge = polygon[(i + 1) % count] - a;
+			const float denominator = cross2D(direction, edge);
+			if (denominator == 0) continue;
+			const float t = cross2D(a - origin, edge) / denominator;
+			const float s = cross2D(a - origin, direction) / denominator;
+			if (t >= 0 && t <= max_distance && s >= 0 && s <= 1) {
+				max_distance = t;
+				result = t;
+			}
+		}
+		return result;
 	}
 
-	void PhysicsComponent::collectVertices() {
-		glm::vec2 rot_vec = glm::vec2(glm::cos(transform->angle), glm::sin(transform->angle));
-		for (int i = 0; i < collider.vertices.size(); ++i) {
-			glm::vec2 v = collider.vertices[i] * transform->size;
-			glm::vec2 r = glm::vec2(v.x * rot_vec.x - v.y * rot_vec.y, v.x * rot_vec.y + v.y * rot_vec.x);
-			collider.utility_vertices[i] = r + transform->pos;
+	float distanceToPolygon(const glm::vec2* polygon, u32 count, glm::vec2 point) {
+		if (!count) return -1;
+		if (containsPoint(polygon, count, point)) return 0;
+		float result = std::numeric_limits<float>::max();
+		for (u32 i = 0; i < count; ++i) {
+			const glm::vec2 a = polygon[i];
+			const glm::vec2 edge = polygon[(i + 1) % count] - a;
+			const float t = glm::clamp(glm::dot(point - a, edge) / glm::dot(edge, edge), 0.f, 1.f);
+			result = glm::min(result, glm::length(a + edge * t - point));
 		}
+		return result;
 	}
 
 	void PhysicsSystem::onRegistered() {
 		parent_ecs->registerComponent(flo::uniqueCode<TransformComponent>());
 		parent_ecs->registerComponent(flo::uniqueCode<PhysicsComponent>());
-		
-		physics_components = ComponentBundleArray(TYPE_VECTOR(TYPEHASH(TransformComponent), TYPEHASH(PhysicsComponent)), *parent_ecs);
+		declareWrites<TransformComponent, PhysicsComponent>();
 	}
 
 	void PhysicsSystem::entityAdded(Entity entity) {
-		physics_components.onAdded(entity);
 	}
 
 	void PhysicsSystem::entityDestroyed(Entity entity) {
-		physics_components.onRemoved(entity);
 	}
 
 	void PhysicsSystem::update(float dt) {
-		for (int i = 0; i < physics_components.size(); ++i) {
-			TransformComponent* tc = (TransformComponent*)physics_components.getComponent(0, i);
-			PhysicsComponent* pc = (PhysicsComponent*)physics_components.getComponent(1, i);
+		accumulator += dt;
+		steps_taken = 0;
+		while (accumulator >= fixed_dt && steps_taken < max_steps) {
+			for (u32 i = 0; i < substeps; ++i) step(fixed_dt / substeps, i == 0, i == substeps - 1);
+			accumulator -= fixed_dt;
+			++steps_taken;
+		}
+		if (accumulator >= fixed_dt) accumulator = glm::mod(accumulator, fixed_dt);
+		alpha = accumulator / fixed_dt;
+	}
+
+	TransformComponent PhysicsSystem::interpolate(const TransformComponent& transform, const PhysicsComponent& body) const {
+		TransformComponent result = transform;
+		result.pos = body.previous_pos + (transform.pos - body.previous_pos) * alpha;
+		//the angles are wrapped into [0, 2pi), so blend along the shorter way
+		const float pi = 3.141592653589f;
+		float delta = transform.angle - body.previous_angle;
+		if (delta > pi) delta -= 2.f * pi;
+		else if (delta < -pi) delta += 2.f * pi;
+		result.angle = body.previous_angle + delta * alpha;
+		return result;
+	}
+
+	bool isPassive(const PhysicsComponent& body) {
+		return body.sleeping || (body.mass <= 0 && body.moment_of_inertia <= 0);
+	}
+
+	void PhysicsSystem::gatherBodies() {
+		bodies.clear();
+		entities.clear();
+		std::vector<std::pair<TransformComponent*, PhysicsComponent*>> passive_bodies;
+		std::vector<Entity> passive_entities;
+		parent_ecs->view<TransformComponent, PhysicsComponent>().each([&](Entity entity, TransformComponent& tc, PhysicsComponent& pc) {
+			//a body whose velocity or force has been set from outside wakes up
+			if (pc.sleeping && (!allow_sleeping || pc.velocity != glm::vec2(0.) || pc.angular_velocity != 0 || pc.force != glm::vec2(0.) || pc.torque != 0)) pc.wake();
+			if (isPassive(pc)) {
+				passive_bodies.push_back(std::make_pair(&tc, &pc));
+				passive_entities.push_back(entity);
+			}
+			else {
+				bodies.push_back(std::make_pair(&tc, &pc));
+				entities.push_back(entity);
+			}
+		});
+		active_count = bodies.size();
+		bodies.insert(bodies.end(), passive_bodies.begin(), passive_bodies.end());
+		entities.insert(entities.end(), passive_entities.begin(), passive_entities.end());
+	}
+
+	void PhysicsSystem::partitionBodies() {
+		//the components cannot be added or removed during an update, so the pointers of the first substep stay valid
+		std::vector<std::pair<TransformComponent*, PhysicsComponent*>> sorted_bodies;
+		std::vector<Entity> sorted_entities;
+		sorted_bodies.reserve(bodies.size());
+		sorted_entities.reserve(entities.size());
+		for (int passive = 0; passive < 2; ++passive) {
+			for (int i = 0; i < bodies.size(); ++i) {
+				if (isPassive(*bodies[i].second) != (passive == 1)) continue;
+				sorted_bodies.push_back(bodies[i]);
+				sorted_entities.push_back(entities[i]);
+			}
+			if (!passive) active_count = sorted_bodies.size();
+		}
+		bodies.swap(sorted_bodies);
+		entities.swap(sorted_entities);
+	}
+
+	void PhysicsSystem::step(float dt, bool first_substep, bool last_substep) {
+		if (first_substep) gatherBodies();
+		else partitionBodies();
+
+		loadBodies(first_substep);
+		collectWorldVertices();
+		updateTree(dt);
+		if (broadphase_type == broadphase_tree) findTreePairs();
+		else spatial_hash.findPairs(bounds.data(), bounds.size(), pairs, active_count);
+
+		contacts.clear();
+		Contact contact;
+		for (int i = 0; i < pairs.size(); ++i) {
+			const u32 a = pairs[i] >> 32, b = (u32)pairs[i];
+			if (!store.isDynamic(a) && !store.isDynamic(b)) continue;
+			const u32 count_a = vertex_offsets[a + 1] - vertex_offsets[a], count_b = vertex_offsets[b + 1] - vertex_offsets[b];
+			const u32 offset_a = vertex_offsets[a], offset_b = vertex_offsets[b];
+			if (!collidePolygons(world_vertices.data() + offset_a, world_normals.data() + offset_a, count_a, world_vertices.data() + offset_b, world_normals.data() + offset_b, count_b, contact.manifold, linear_slop)) continue;
+			//a sleeping body acts as immovable for the rest of this update and is woken by bodies that are not resting
+			if (a >= active_count && !isResting(b)) bodies[a].second->wake();
+			if (b >= active_count && !isResting(a)) bodies[b].second->wake();
+			contact.a = a;
+			contact.b = b;
+			contact.tile_box = 0;
+			contacts.push_back(contact);
+		}
+		collideTiles();
+		store.integrateVelocities(dt, active_count, gravity);
+		buildIslands();
+		solveIslands(dt);
+		updateContactCache();
+		store.integratePositions(dt, active_count);
+		updateSleep(dt);
+		storeBodies(last_substep);
+	}
+
+	u32 PhysicsSystem::addShape(const Collider& collider) {
+		shapes.push_back(collider);
+		return shapes.size() - 1;
+	}
+
+	void PhysicsSystem::setTileSolid(u16 type, bool solid) {
+		if (type >= solid_tiles.size()) solid_tiles.resize(type + 1, 0);
+		solid_tiles[type] = solid;
+		if (!tilemap) return;
+		for (int i = 0; i < tilemap->chunks.size(); ++i) tilemap->chunks[i].solid_mask_needed = true;
+	}
+
+	Entity PhysicsSystem::getEntity(u32 body) const {
+		return body < entities.size() ? entities[body] : 0;
+	}
+
+	void PhysicsSystem::queryRegion(const AABB& region, std::vector<Entity>& result) {
+		std::vector<u32> leaves;
+		tree.query(region, leaves);
+		for (int i = 0; i < leaves.size(); ++i) {
+			const u32 body = proxy_bodies[leaves[i]];
+			if (bounds[body].overlaps(region)) result.push_back(entities[body]);
+		}
+	}
+
+	Entity PhysicsSystem::raycast(glm::vec2 origin, glm::vec2 direction, float max_distance, float& distance) {
+		const u32 proxy = tree.raycast(origin, direction, max_distance, [this, origin, direction](u32 proxy, float max_distance) {
+			const u32 body = proxy_bodies[proxy];
+			return raycastPolygon(world_vertices.data() + vertex_offsets[body], vertex_offsets[body + 1] - vertex_offsets[body], origin, direction, max_distance);
+		}, distance);
+		return proxy == DynamicTree::null_node ? 0 : tree.nodes[proxy].user;
+	}
+
+	Entity PhysicsSystem::nearest(glm::vec2 point, float max_distance, float& distance) {
+		const u32 proxy = tree.nearest(point, max_distance, [this, point](u32 proxy) {
+			const u32 body = proxy_bodies[proxy];
+			return distanceToPolygon(world_vertices.data() + vertex_offsets[body], vertex_offsets[body + 1] - vertex_offsets[body], point);
+		}, distance);
+		return proxy == DynamicTree::null_node ? 0 : tree.nodes[proxy].user;
+	}
+
+	void PhysicsSystem::updateTree(float dt) {
+		proxy_bodies.assign(tree.nodes.size(), invalid_index);
+		for (int i = 0; i < bodies.size(); ++i) {
+			u32 proxy = proxies.get(entities[i]);
+			if (proxy == invalid_index || proxy >= tree.nodes.size() || !tree.nodes[proxy].isLeaf() || tree.nodes[proxy].user != entities[i]) {
+				proxy = tree.createProxy(bounds[i], entities[i]);
+				proxies.set(entities[i], proxy);
+				proxy_bodies.resize(tree.nodes.size(), invalid_index);
+			}
+			else if (!unmoved[i]) {
+				//resting leaves only pay for the containment test, but immovable bodies may still have been moved from outside
+				const glm::vec2 displacement = i < active_count ? glm::vec2(store.vel_x[i], store.vel_y[i]) * dt : glm::vec2(0.);
+				tree.moveProxy(proxy, bounds[i], displacement);
+			}
+			proxy_bodies[proxy] = i;
+		}
+
+		std::vector<u32> leaves;
+		for (u32 proxy = 0; proxy < tree.nodes.size(); ++proxy) {
+			if (!tree.nodes[proxy].isLeaf() || proxy_bodies[proxy] != invalid_index) continue;
+			//sleeping bodies are only woken by moving ones, so those resting on a body that has been removed would float
+			leaves.clear();
+			tree.query(tree.nodes[proxy].box, leaves);
+			for (int l = 0; l < leaves.size(); ++l) {
+				const u32 body = proxy_bodies[leaves[l]];
+				if (body != invalid_index && body >= active_count) bodies[body].second->wake();
+			}
+			if (proxies.get(tree.nodes[proxy].user) == proxy) proxies.erase(tree.nodes[proxy].user);
+			tree.destroyProxy(proxy);
+		}
+	}
+
+	void PhysicsSystem::findTreePairs() {
+		pairs.clear();
+		std::vector<u32> leaves;
+		//the sleeping and immovable bodies come last, so pairs of two such bodies are never looked for
+		for (u32 i = 0; i < active_count; ++i) {
+			leaves.clear();
+			tree.query(bounds[i], leaves);
+			for (int l = 0; l < leaves.size(); ++l) {
+				const u32 j = proxy_bodies[leaves[l]];
+				if (j > i && bounds[i].overlaps(bounds[j])) pairs.push_back((u64)i << 32 | j);
+			}
+		}
+		std::sort(pairs.begin(), pairs.end());
+	}
+
+	void PhysicsSystem::loadBodies(bool first_substep) {
+		//the last slot stands in for the tilemap: immovable, at the origin and never stored back
+		tile_body = bodies.size();
+		store.resize(bodies.size() + 1);
+		store.pos_x[tile_body] = store.pos_y[tile_body] = store.angle[tile_body] = 0;
+		store.vel_x[tile_body] = store.vel_y[tile_body] = store.angular_velocity[tile_body] = 0;
+		store.force_x[tile_body] = store.force_y[tile_body] = store.torque[tile_body] = 0;
+		store.inverse_mass[tile_body] = store.inverse_inertia[tile_body] = 0;
+		for (u32 i = 0; i < bodies.size(); ++i) {
+			const TransformComponent& transform = *bodies[i].first;
+			PhysicsComponent& body = *bodies[i].second;
+			if (first_substep) {
+				body.previous_pos = transform.pos;
+				body.previous_angle = transform.angle;
+			}
+			store.pos_x[i] = transform.pos.x;
+			store.pos_y[i] = transform.pos.y;
+			store.angle[i] = transform.angle;
+			store.vel_x[i] = body.velocity.x;
+			store.vel_y[i] = body.velocity.y;
+			store.angular_velocity[i] = body.angular_velocity;
+			store.force_x[i] = body.force.x;
+			store.force_y[i] = body.force.y;
+			store.torque[i] = body.torque;
+			store.inverse_mass[i] = body.mass > 0 && i < active_count ? 1.f / body.mass : 0.f;
+			store.inverse_inertia[i] = body.moment_of_inertia > 0 && i < active_count ? 1.f / body.moment_of_inertia : 0.f;
+		}
+		sin_cos(store.angle.data(), store.size, store.sines.data(), store.cosines.data());
+	}
+
+	void PhysicsSystem::storeBodies(bool last_substep) {
+		for (u32 i = 0; i < active_count; ++i) {
+			TransformComponent& transform = *bodies[i].first;
+			PhysicsComponent& body = *bodies[i].second;
+			transform.pos = glm::vec2(store.pos_x[i], store.pos_y[i]);
+			transform.angle = store.angle[i];
+			body.velocity = glm::vec2(store.vel_x[i], store.vel_y[i]);
+			body.angular_velocity = store.angular_velocity[i];
+			//the forces act during the whole step, so every substep loads them again
+			if (!last_substep) continue;
+			body.force = glm::vec2(0.);
+			body.torque = 0;
+		}
+	}
+
+	glm::vec2 crossScalar(float w, glm::vec2 r) {
+		return glm::vec2(-w * r.y, w * r.x);
+	}
+
+	bool cacheOrder(const CachedContact& left, const CachedContact& right) {
+		if (left.a != right.a) return left.a < right.a;
+		if (left.b != right.b) return left.b < right.b;
+		return left.tile_box < right.tile_box;
+	}
+
+	void PhysicsSystem::prepareContact(Contact& contact, float dt) {
+		const u32 a = contact.a, b = contact.b;
+		const Manifold& manifold = contact.manifold;
+		const glm::vec2 normal = manifold.normal, tangent = skew(normal);
+		const glm::vec2 center_a = glm::vec2(store.pos_x[a], store.pos_y[a]), center_b = glm::vec2(store.pos_x[b], store.pos_y[b]);
 
-			for (int j = i + 1; j < physics_components.size(); ++j) {
-				PhysicsComponent* pc2 = (PhysicsComponent*)physics_components.getComponent(1, j);
-				pc->handle_collision(*pc2, dt);
+		const CachedContact* cached = nullptr;
+		if (warm_starting) {
+			CachedContact key;
+			key.a = getEntity(a);
+			key.b = getEntity(b);
+			key.tile_box = contact.tile_box;
+			std::vector<CachedContact>::const_iterator found = std::lower_bound(contact_cache.begin(), contact_cache.end(), key, cacheOrder);
+			if (found != contact_cache.end() && found->a == key.a && found->b == key.b && found->tile_box == key.tile_box) cached = &*found;
+		}
+
+		const float inverse_mass = store.inverse_mass[a] + store.inverse_mass[b];
+		float rn_a[2], rn_b[2], normal_diagonal[2];
+		for (u32 i = 0; i < manifold.point_count; ++i) {
+			const glm::vec2 ra = manifold.points[i] - center_a, rb = manifold.points[i] - center_b;
+			contact.offsets_a[i] = ra;
+			contact.offsets_b[i] = rb;
+
+			rn_a[i] = cross2D(ra, normal);
+			rn_b[i] = cross2D(rb, normal);
+			normal_diagonal[i] = inverse_mass + store.inverse_inertia[a] * rn_a[i] * rn_a[i] + store.inverse_inertia[b] * rn_b[i] * rn_b[i];
+			contact.normal_masses[i] = normal_diagonal[i] > 0 ? 1.f / normal_diagonal[i] : 0.f;
+			const float rt_a = cross2D(ra, tangent), rt_b = cross2D(rb, tangent);
+			const float tangent_mass = inverse_mass + store.inverse_inertia[a] * rt_a * rt_a + store.inverse_inertia[b] * rt_b * rt_b;
+			contact.tangent_masses[i] = tangent_mass > 0 ? 1.f / tangent_mass : 0.f;
+			//a point that is not touching yet lets the bodies approach until it does
+			const float depth = manifold.depths[i];
+			contact.biases[i] = depth < 0 ? depth / dt : baumgarte / dt * glm::max(depth - linear_slop, 0.f);
+		}
+
+		//the points of a resting face push against each other through the rotation of the bodies, so solving them one after another
+		//never quite converges and lets stacks sway; they are solved as a 2x2 block instead, unless the points are nearly redundant
+		contact.block_solve = false;
+		if (manifold.point_count == 2) {
+			const float k11 = normal_diagonal[0], k22 = normal_diagonal[1];
+			const float k12 = inverse_mass + store.inverse_inertia[a] * rn_a[0] * rn_a[1] + store.inverse_inertia[b] * rn_b[0] * rn_b[1];
+			const float determinant = k11 * k22 - k12 * k12;
+			const float max_condition = 1000.f;
+			if (k11 > 0 && k11 * k11 < max_condition * determinant) {
+				contact.block_solve = true;
+				contact.normal_matrix[0] = k11;
+				contact.normal_matrix[1] = k12;
+				contact.normal_matrix[2] = k22;
+				contact.inverse_normal_matrix[0] = k22 / determinant;
+				contact.inverse_normal_matrix[1] = -k12 / determinant;
+				contact.inverse_normal_matrix[2] = k11 / determinant;
+			}
+		}
+
+		for (u32 i = 0; i < manifold.point_count; ++i) {
+			contact.normal_impulses[i] = contact.tangent_impulses[i] = 0;
+			if (!cached) continue;
+			for (u32 j = 0; j < cached->point_count; ++j) {
+				if (cached->features[j] != manifold.features[i]) continue;
+				contact.normal_impulses[i] = cached->normal_impulses[j];
+				contact.tangent_impulses[i] = cached->tangent_impulses[j];
+				applyImpulse(contact, i, normal * contact.normal_impulses[i] + tangent * contact.tangent_impulses[i]);
+				break;
+			}
+		}
+	}
+
+	glm::vec2 PhysicsSystem::getRelativeVelocity(const Contact& contact, u32 point) const {
+		const u32 a = contact.a, b = contact.b;
+		return glm::vec2(store.vel_x[b], store.vel_y[b]) + crossScalar(store.angular_velocity[b], contact.offsets_b[point])
+			- glm::vec2(store.vel_x[a], store.vel_y[a]) - crossScalar(store.angular_velocity[a], contact.offsets_a[point]);
+	}
+
+	void PhysicsSystem::solveContact(Contact& contact) {
+		const glm::vec2 normal = contact.manifold.normal, tangent = skew(normal);
+		const u32 point_count = contact.manifold.point_count;
+
+		//friction first, limited by the normal impulse of the last iteration
+		for (u32 i = 0; i < point_count; ++i) {
+			const float max_friction = friction * contact.normal_impulses[i];
+			const float old_tangent = contact.tangent_impulses[i];
+			contact.tangent_impulses[i] = glm::clamp(old_tangent - glm::dot(getRelativeVelocity(contact, i), tangent) * contact.tangent_masses[i], -max_friction, max_friction);
+			applyImpulse(contact, i, tangent * (contact.tangent_impulses[i] - old_tangent));
+		}
+
+		if (!contact.block_solve) {
+			//the accumulated normal impulse may only push, but a single iteration may take some of it back
+			for (u32 i = 0; i < point_count; ++i) {
+				const float old_normal = contact.normal_impulses[i];
+				contact.normal_impulses[i] = glm::max(old_normal + (contact.biases[i] - glm::dot(getRelativeVelocity(contact, i), normal)) * contact.normal_masses[i], 0.f);
+				applyImpulse(contact, i, normal * (contact.normal_impulses[i] - old_normal));
+			}
+			return;
+		}
+
+		//find the accumulated impulses x >= 0 with the velocities vn = K * x + b >= 0 and x * vn = 0 by trying which points are active,
+		//where b holds the velocities that remain once the current impulses are taken out
+		const float* k = contact.normal_matrix;
+		const float* inverse = contact.inverse_normal_matrix;
+		const float old_x[2] = { contact.normal_impulses[0], contact.normal_impulses[1] };
+		const float b0 = glm::dot(getRelativeVelocity(contact, 0), normal) - contact.biases[0] - (k[0] * old_x[0] + k[1] * old_x[1]);
+		const float b1 = glm::dot(getRelativeVelocity(contact, 1), normal) - contact.biases[1] - (k[1] * old_x[0] + k[2] * old_x[1]);
+		float x0, x1;
+		//both points push
+		x0 = -(inverse[0] * b0 + inverse[1] * b1);
+		x1 = -(inverse[1] * b0 + inverse[2] * b1);
+		if (x0 < 0 || x1 < 0) {
+			//only the first point pushes and the second one separates
+			x0 = -contact.normal_masses[0] * b0;
+			x1 = 0;
+			if (x0 < 0 || k[1] * x0 + b1 < 0) {
+				//only the second point pushes
+				x0 = 0;
+				x1 = -contact.normal_masses[1] * b1;
+				if (x1 < 0 || k[1] * x1 + b0 < 0) {
+					//neither pushes; if even that fails, the impulses are kept
+					x1 = 0;
+					if (b0 < 0 || b1 < 0) return;
+				}
+			}
+		}
+		contact.normal_impulses[0] = x0;
+		contact.normal_impulses[1] = x1;
+		applyImpulse(contact, 0, normal * (x0 - old_x[0]));
+		applyImpulse(contact, 1, normal * (x1 - old_x[1]));
+	}
+
+	void PhysicsSystem::applyImpulse(const Contact& contact, u32 point, glm::vec2 impulse) {
+		//immovable bodies may be shared by islands solved in parallel, so they are never written to
+		const u32 a = contact.a, b = contact.b;
+		if (store.isDynamic(a)) {
+			store.vel_x[a] -= impulse.x * store.inverse_mass[a];
+			store.vel_y[a] -= impulse.y * store.inverse_mass[a];
+			store.angular_velocity[a] -= cross2D(contact.offsets_a[point], impulse) * store.inverse_inertia[a];
+		}
+		if (store.isDynamic(b)) {
+			store.vel_x[b] += impulse.x * store.inverse_mass[b];
+			store.vel_y[b] += impulse.y * store.inverse_mass[b];
+			store.angular_velocity[b] += cross2D(contact.offsets_b[point], impulse) * store.inverse_inertia[b];
+		}
+	}
+
+	void PhysicsSystem::updateContactCache() {
+		contact_cache.resize(contacts.size());
+		for (int i = 0; i < contacts.size(); ++i) {
+			const Contact& contact = contacts[i];
+			CachedContact& cached = contact_cache[i];
+			cached.a = getEntity(contact.a);
+			cached.b = getEntity(contact.b);
+			cached.tile_box = contact.tile_box;
+			cached.point_count = contact.manifold.point_count;
+			for (u32 p = 0; p < cached.point_count; ++p) {
+				cached.features[p] = contact.manifold.features[p];
+				cached.normal_impulses[p] = contact.normal_impulses[p];
+				cached.tangent_impulses[p] = contact.tangent_impulses[p];
+			}
+		}
+		std::sort(contact_cache.begin(), contact_cache.end(), cacheOrder);
+	}
+
+	u32 findRoot(std::vector<u32>& parents, u32 node) {
+		while (parents[node] != node) {
+			parents[node] = parents[parents[node]];
+			node = parents[node];
+		}
+		return node;
+	}
+
+	void PhysicsSystem::buildIslands() {
+		const u32 body_count = store.size;
+		std::vector<u32> parents(body_count);
+		for (u32 i = 0; i < body_count; ++i) parents[i] = i;
+		for (int i = 0; i < contacts.size(); ++i) {
+			if (!store.isDynamic(contacts[i].a) || !store.isDynamic(contacts[i].b)) continue;
+			const u32 root_a = findRoot(parents, contacts[i].a), root_b = findRoot(parents, contacts[i].b);
+			//the lower index becomes the root, so that the roots do not depend on the contact order
+			if (root_a < root_b) parents[root_b] = root_a;
+			else parents[root_a] = root_b;
+		}
+
+		//number the islands in the order of their lowest body and count their bodies and contacts
+		islands.clear();
+		body_islands.assign(body_count, invalid_index);
+		for (u32 i = 0; i < body_count; ++i) {
+			if (!store.isDynamic(i)) continue;
+			const u32 root = findRoot(parents, i);
+			if (root == i) {
+				body_islands[i] = islands.size();
+				islands.push_back(Island());
+			}
+			else body_islands[i] = body_islands[root];
+			++islands[body_islands[i]].body_count;
+		}
+		for (int i = 0; i < contacts.size(); ++i) {
+			const u32 dynamic_body = store.isDynamic(contacts[i].a) ? contacts[i].a : contacts[i].b;
+			++islands[body_islands[dynamic_body]].contact_count;
+		}
+
+		u32 body_offset = 0, contact_offset = 0;
+		for (int i = 0; i < islands.size(); ++i) {
+			islands[i].body_begin = body_offset;
+			islands[i].contact_begin = contact_offset;
+			body_offset += islands[i].body_count;
+			contact_offset += islands[i].contact_count;
+			islands[i].body_count = islands[i].contact_count = 0;
+		}
+		island_bodies.resize(body_offset);
+		island_contacts.resize(contact_offset);
+		for (u32 i = 0; i < body_count; ++i) {
+			if (body_islands[i] == invalid_index) continue;
+			Island& island = islands[body_islands[i]];
+			island_bodies[island.body_begin + island.body_count++] = i;
+		}
+		for (u32 i = 0; i < contacts.size(); ++i) {
+			const u32 dynamic_body = store.isDynamic(contacts[i].a) ? contacts[i].a : contacts[i].b;
+			Island& island = islands[body_islands[dynamic_body]];
+			island_contacts[island.contact_begin + island.contact_count++] = i;
+		}
+	}
+
+	bool PhysicsSystem::isResting(u32 body) const {
+		const float speed_squared = store.vel_x[body] * store.vel_x[body] + store.vel_y[body] * store.vel_y[body];
+		return speed_squared <= linear_sleep_tolerance * linear_sleep_tolerance && glm::abs(store.angular_velocity[body]) <= angular_sleep_tolerance;
+	}
+
+	void PhysicsSystem::updateSleep(float dt) {
+		if (!allow_sleeping) return;
+		for (int i = 0; i < islands.size(); ++i) {
+			const Island& island = islands[i];
+			float min_sleep_time = std::numeric_limits<float>::max();
+			for (u32 b = island.body_begin; b < island.body_begin + island.body_count; ++b) {
+				const u32 body = island_bodies[b];
+				PhysicsComponent& component = *bodies[body].second;
+				component.sleep_time = isResting(body) ? component.sleep_time + dt : 0;
+				min_sleep_time = glm::min(min_sleep_time, component.sleep_time);
 			}
+			if (min_sleep_time < time_to_sleep) continue;
 
-			pc->runStep(dt, *tc);
+			for (u32 b = island.body_begin; b < island.body_begin + island.body_count; ++b) {
+				const u32 body = island_bodies[b];
+				bodies[body].second->sleeping = true;
+				store.vel_x[body] = store.vel_y[body] = store.angular_velocity[body] = 0;
+			}
+		}
+	}
+
+	void PhysicsSystem::solveIslands(float dt) {
+		auto solve = [this, dt](u32 begin, u32 end) {
+			for (u32 i = begin; i < end; ++i) {
+				const Island& island = islands[i];
+				const u32* island_contact = island_contacts.data() + island.contact_begin;
+				for (u32 c = 0; c < island.contact_count; ++c) prepareContact(contacts[island_contact[c]], dt);
+				for (u32 iteration = 0; iteration < velocity_iterations; ++iteration) {
+					for (u32 c = 0; c < island.contact_count; ++c) solveContact(contacts[island_contact[c]]);
+				}
+			}
+		};
+
+		ThreadPool* pool = parent_ecs->thread_pool;
+		if (!pool || contacts.size() < min_parallel_contacts) solve(0, islands.size());
+		else pool->parallelFor(islands.size(), islands.size() / (pool->getThreadCount() * 4 + 4) + 1, solve);
+	}
+
+	void PhysicsSystem::collectWorldVertices() {
+		world_vertices.swap(previous_vertices);
+		world_normals.swap(previous_normals);
+		vertex_offsets.swap(previous_offsets);
+		bounds.swap(previous_bounds);
+		fitted_bodies.swap(previous_fits);
+
+		vertex_offsets.resize(bodies.size() + 1);
+		u32 total = 0;
+		for (int i = 0; i < bodies.size(); ++i) {
+			vertex_offsets[i] = total;
+			const u32 shape = bodies[i].second->shape;
+			if (shape != invalid_index) total += shapes[shape].vertices.size();
+		}
+		vertex_offsets[bodies.size()] = total;
+		world_vertices.resize(total);
+		world_normals.resize(total);
+
+		bounds.resize(bodies.size());
+		fitted_bodies.resize(bodies.size());
+		unmoved.assign(bodies.size(), 0);
+		for (int i = 0; i < bodies.size(); ++i) {
+			const glm::vec2 size = bodies[i].first->size, pos = glm::vec2(store.pos_x[i], store.pos_y[i]);
+			const u32 count = vertex_offsets[i + 1] - vertex_offsets[i];
+			FittedBody& fitted = fitted_bodies[i];
+			fitted.pos = pos;
+			fitted.size = size;
+			fitted.angle = store.angle[i];
+			fitted.shape = bodies[i].second->shape;
+
+			if (i >= active_count) {
+				//the tree still maps the leaf of the body to its index in the previous substep
+				const u32 proxy = proxies.get(entities[i]);
+				const bool known = proxy < proxy_bodies.size() && proxy_bodies[proxy] < previous_fits.size() && tree.nodes[proxy].isLeaf() && tree.nodes[proxy].user == entities[i];
+				const u32 previous = known ? proxy_bodies[proxy] : invalid_index;
+				if (known && previous_fits[previous].pos == fitted.pos && previous_fits[previous].size == fitted.size && previous_fits[previous].angle == fitted.angle
+					&& previous_fits[previous].shape == fitted.shape && previous_offsets[previous + 1] - previous_offsets[previous] == count) {
+					std::copy(previous_vertices.begin() + previous_offsets[previous], previous_vertices.begin() + previous_offsets[previous + 1], world_vertices.begin() + vertex_offsets[i]);
+					std::copy(previous_normals.begin() + previous_offsets[previous], previous_normals.begin() + previous_offsets[previous + 1], world_normals.begin() + vertex_offsets[i]);
+					bounds[i] = previous_bounds[previous];
+					unmoved[i] = 1;
+					continue;
+				}
+			}
+
+			if (!count) {
+				const glm::vec2 half_size = size * 1.415f;
+				bounds[i] = AABB(pos - half_size, pos + half_size);
+				continue;
+			}
+
+			const std::vector<glm::vec2>& local = shapes[bodies[i].second->shape].vertices;
+			const glm::vec2 rot_vec = glm::vec2(store.cosines[i], store.sines[i]);
+			glm::vec2* world = world_vertices.data() + vertex_offsets[i];
+			glm::vec2 min = glm::vec2(std::numeric_limits<float>::max()), max = -min;
+			for (int v = 0; v < local.size(); ++v) {
+				const glm::vec2 scaled = local[v] * size;
+				world[v] = glm::vec2(scaled.x * rot_vec.x - scaled.y * rot_vec.y, scaled.x * rot_vec.y + scaled.y * rot_vec.x) + pos;
+				min = glm::min(min, world[v]);
+				max = glm::max(max, world[v]);
+			}
+			computeNormals(world, local.size(), world_normals.data() + vertex_offsets[i]);
+			//bodies closer than the slop are paired too, so that resting contacts do not flicker
+			bounds[i] = AABB(min - glm::vec2(linear_slop), max + glm::vec2(linear_slop));
+		}
+	}
+
+	glm::ivec2 tileAt(glm::vec2 pos, float tile_size) {
+		return glm::ivec2((int)std::floor(pos.x / tile_size + .5f), (int)std::floor(pos.y / tile_size + .5f));
+	}
+
+	u32 lowBits(int count) {
+		return count >= 32 ? ~0u : (1u << count) - 1;
+	}
+
+	u32 readBits(const u32* row, int begin, int count) {
+		const int word = begin >> 5, shift = begin & 31;
+		u32 bits = row[word] >> shift;
+		if (shift && shift + count > 32) bits |= row[word + 1] << (32 - shift);
+		return bits & lowBits(count);
+	}
+
+	void writeBits(u32* row, int begin, u32 bits, int count) {
+		const int word = begin >> 5, shift = begin & 31;
+		row[word] |= bits << shift;
+		if (shift && shift + count > 32) row[word + 1] |= bits >> (32 - shift);
+	}
+
+	bool hasBits(const u32* row, int begin, int end) {
+		for (int bit = begin; bit < end; bit += 32) {
+			const int count = std::min(32, end - bit);
+			if (readBits(row, bit, count) != lowBits(count)) return false;
+		}
+		return true;
+	}
+
+	void clearBits(u32* row, int begin, int end) {
+		for (int bit = begin; bit < end; bit += 32) {
+			const int count = std::min(32, end - bit), word = bit >> 5, shift = bit & 31;
+			row[word] &= ~(lowBits(count) << shift);
+			if (shift && shift + count > 32) row[word + 1] &= ~(lowBits(count) >> (32 - shift));
+		}
+	}
+
+	void PhysicsSystem::collideTiles() {
+		if (!tilemap) return;
+		const float tile_size = TILE_SPRITE_SIZE;
+		const int chunk_size = tilemap->chunk_size, row_words = (chunk_size + 31) / 32;
+		//a body resting on a chunk that has been unloaded since would float, as missing chunks have no tiles
+		const bool unloaded = tilemap->unload_count != seen_unload_count;
+		seen_unload_count = tilemap->unload_count;
+
+		//sleeping bodies do not look for tile contacts, so they are woken when the tiles under them may have changed
+		for (u32 i = active_count; i < bodies.size(); ++i) {
+			if (!bodies[i].second->sleeping) continue;
+			const glm::ivec2 min = tileAt(bounds[i].min, tile_size), max = tileAt(bounds[i].max, tile_size);
+			bool changed = false;
+			for (int cy = divideFixed(min.y, chunk_size); cy <= divideFixed(max.y, chunk_size) && !changed; ++cy) {
+				for (int cx = divideFixed(min.x, chunk_size); cx <= divideFixed(max.x, chunk_size) && !changed; ++cx) {
+					const Chunk* chunk = tilemap->getChunk(cx, cy);
+					changed = chunk ? chunk->solid_mask_needed : unloaded;
+				}
+			}
+			if (changed) bodies[i].second->wake();
+		}
+
+		Contact contact;
+		for (u32 i = 0; i < active_count; ++i) {
+			const u32 vertex_count = vertex_offsets[i + 1] - vertex_offsets[i];
+			if (!vertex_count) continue;
+			const glm::ivec2 min = tileAt(bounds[i].min, tile_size), max = tileAt(bounds[i].max, tile_size);
+			const int width = max.x - min.x + 1, height = max.y - min.y + 1, width_words = (width + 31) / 32;
+			tile_rows.assign(width_words * height, 0);
+
+			//copy the solidity of the tiles under the body out of the masks of the chunks they lie in, 32 tiles at a time
+			bool any_solid = false;
+			for (int cy = divideFixed(min.y, chunk_size); cy <= divideFixed(max.y, chunk_size); ++cy) {
+				for (int cx = divideFixed(min.x, chunk_size); cx <= divideFixed(max.x, chunk_size); ++cx) {
+					Chunk* chunk = tilemap->getChunk(cx, cy);
+					if (!chunk || !chunk->tiles) continue;
+					const u32* mask = chunk->getSolidMask(solid_tiles);
+					const int x0 = std::max(min.x, cx * chunk_size), x1 = std::min(max.x, cx * chunk_size + chunk_size - 1);
+					const int y0 = std::max(min.y, cy * chunk_size), y1 = std::min(max.y, cy * chunk_size + chunk_size - 1);
+					for (int y = y0; y <= y1; ++y) {
+						const u32* source = mask + (y - cy * chunk_size) * row_words;
+						u32* row = tile_rows.data() + (y - min.y) * width_words;
+						for (int x = x0; x <= x1; x += 32) {
+							const int count = std::min(32, x1 - x + 1);
+							const u32 bits = readBits(source, x - cx * chunk_size, count);
+							if (!bits) continue;
+							writeBits(row, x - min.x, bits, count);
+							any_solid = true;
+						}
+					}
+				}
+			}
+			if (!any_solid) continue;
+
+			//merge runs of solid tiles, then stack runs of the same extent, so that flat ground or a wall becomes a single box
+			for (int y = 0; y < height; ++y) {
+				u32* row = tile_rows.data() + y * width_words;
+				for (int word = 0; word < width_words; ++word) {
+					while (row[word]) {
+						int x = word * 32;
+						while (!(row[word] >> (x & 31) & 1)) ++x;
+						int x_end = x + 1, y_end = y + 1;
+						while (x_end < width && row[x_end >> 5] >> (x_end & 31) & 1) ++x_end;
+						while (y_end < height && hasBits(tile_rows.data() + y_end * width_words, x, x_end)) ++y_end;
+						for (int cell_y = y; cell_y < y_end; ++cell_y) clearBits(tile_rows.data() + cell_y * width_words, x, x_end);
+
+						const glm::vec2 box_min = glm::vec2(min.x + x - .5f, min.y + y - .5f) * tile_size;
+						const glm::vec2 box_max = glm::vec2(min.x + x_end - .5f, min.y + y_end - .5f) * tile_size;
+						const glm::vec2 box[4] = { box_min, glm::vec2(box_max.x, box_min.y), box_max, glm::vec2(box_min.x, box_max.y) };
+						glm::vec2 box_normals[4];
+						computeNormals(box, 4, box_normals);
+						const u32 offset = vertex_offsets[i];
+						if (!collidePolygons(world_vertices.data() + offset, world_normals.data() + offset, vertex_count, box, box_normals, 4, contact.manifold, linear_slop)) continue;
+						//the box is clipped to the body, so the warm starting key is taken from the solid run it belongs to: walk left along its top row
+						//and then up as far as the tiles are solid, staying within the chunk so that the walk is short
+						const int cx = divideFixed(min.x + x, chunk_size), cy = divideFixed(min.y + y_end - 1, chunk_size);
+						const u32* mask = tilemap->getChunk(cx, cy)->getSolidMask(solid_tiles);
+						int key_x = min.x + x - cx * chunk_size, key_y = min.y + y_end - 1 - cy * chunk_size;
+						while (key_x > 0 && mask[key_y * row_words + ((key_x - 1) >> 5)] >> ((key_x - 1) & 31) & 1) --key_x;
+						while (key_y < chunk_size - 1 && mask[(key_y + 1) * row_words + (key_x >> 5)] >> (key_x & 31) & 1) ++key_y;
+						contact.a = i;
+						contact.b = tile_body;
+						//20 bits per chunk coordinate and 24 for the tile within the chunk
+						contact.tile_box = (u64)((u32)cx & 0xfffff) << 44 | (u64)((u32)cy & 0xfffff) << 24 | (u64)((u32)(key_y * chunk_size + key_x) & 0xffffff);
+						contacts.push_back(contact);
+					}
+				}
+			}
 		}
 	}
 }
\ No newline at end of file
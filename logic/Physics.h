@@ -1,26 +1,76 @@
 #pragma once
 #include "ECS.h"
 #include "Matrices.h"
+#include "Broadphase.h"
 
 namespace flo {
-	struct Collision {
-		glm::vec2 clip_vec = glm::vec2(0.);
-		glm::vec2 point = glm::vec2(0.);
+	struct InfiniteTileHandler;
 
-		Collision() = default;
+	///<summary>
+	/// The contact between two convex polygons.
+	///</summary>
+	struct Manifold {
+		///<summary>
+		/// The direction from the first polygon to the second one, normalized.
+		///</summary>
+		glm::vec2 normal = glm::vec2(0.);
+
+		///<summary>
+		/// The contact points, lying on the surface of the incident polygon, and their penetration depths.
+		/// Points within the margin passed to collidePolygons() are kept with a negative depth.
+		///</summary>
+		glm::vec2 points[2];
+		float depths[2];
+		u32 point_count = 0;
+
+		///<summary>
+		/// The reference face and incident vertex every point stems from, so that points can be matched across steps.
+		///</summary>
+		u32 features[2];
+
+		Manifold() = default;
+
+		///<summary>
+		/// The largest penetration depth of all points.
+		///</summary>
+		float getDepth() const;
 	};
 
+	///<summary>
+	/// Compute the outward normals of a polygon's edges, for either winding.
+	///</summary>
+	///<param name="vertices">The vertices of the polygon.</param>
+	///<param name="count">The amount of vertices.</param>
+	///<param name="normals">Outputs the normal of the edge from every vertex to the next one.</param>
+	void computeNormals(const glm::vec2* vertices, u32 count, glm::vec2* normals);
+
+	///<summary>
+	/// Test two convex polygons by separating axes. The face of least penetration is used as the reference face, and the
+	/// most opposed face of the other polygon is clipped against it, giving up to two contact points.
+	///</summary>
+	///<param name="vertices_a">The vertices of the first polygon.</param>
+	///<param name="normals_a">The edge normals of the first polygon, as computed by computeNormals().</param>
+	///<param name="count_a">The amount of vertices of the first polygon.</param>
+	///<param name="vertices_b">The vertices of the second polygon.</param>
+	///<param name="normals_b">The edge normals of the second polygon.</param>
+	///<param name="count_b">The amount of vertices of the second polygon.</param>
+	///<param name="manifold">Outputs the contact if there is one.</param>
+	///<param name="margin">The distance up to which separated polygons still count as touching.</param>
+	///<returns>True if the polygons overlap or are closer than the margin.</returns>
+	bool collidePolygons(const glm::vec2* vertices_a, const glm::vec2* normals_a, u32 count_a, const glm::vec2* vertices_b, const glm::vec2* normals_b, u32 count_b, Manifold& manifold, float margin = 0);
+
+	///<summary>
+	/// A convex polygon in the local space of a body, scaled by the size of the body's transform.
+	/// Colliders are shared between bodies through PhysicsSystem::shapes.
+	///</summary>
 	struct Collider {
 		std::vector<glm::vec2> vertices;
-		std::vector<glm::vec2> utility_vertices;
 
 		Collider() = default;
 
 		Collider(std::vector<glm::vec2> vertices);
 
 		float getMomentOfInertia(glm::vec2 scale);
-
-		Collision collide(Collider& other, glm::vec2 center_point);
 	};
 
 	struct PhysicsComponent {
@@ -29,28 +79,388 @@ namespace flo {
 		float moment_of_inertia = 1, mass = 1;
 		glm::vec2 force = glm::vec2(0.);
 		float torque = 0.;
-		TransformComponent* transform;
-		Collider collider;
+
+		///<summary>
+		/// The index of the collider in PhysicsSystem::shapes, or invalid_index for a body that collides with nothing.
+		///</summary>
+		u32 shape = invalid_index;
+
+		///<summary>
+		/// How long the body has been moving slower than the sleep tolerances of PhysicsSystem.
+		///</summary>
+		float sleep_time = 0;
+
+		///<summary>
+		/// Whether the body is at rest. Sleeping bodies are not integrated and act as immovable until they are woken,
+		/// which happens when a force is applied, their velocity is set, or a moving body touches them.
+		///</summary>
+		bool sleeping = false;
+
+		///<summary>
+		/// The position and angle of the transform at the start of the last fixed step, see PhysicsSystem::interpolate(). WARNING: READ-ONLY!
+		///</summary>
+		glm::vec2 previous_pos = glm::vec2(0.);
+		float previous_angle = 0;
 
 		PhysicsComponent() = default;
 
 		PhysicsComponent(float moment_of_inertia, float mass, glm::vec2 velocity = glm::vec2(0.), float angular_velocity = 0.);
 
-		void assignComponents(Collider& collider, TransformComponent& transform);
+		///<summary>
+		/// Set the collider of the body and start interpolating from its transform.
+		///</summary>
+		///<param name="shape">The index of the collider in PhysicsSystem::shapes.</param>
+		///<param name="transform">The transform of the body's entity.</param>
+		void assignComponents(u32 shape, const TransformComponent& transform);
+
+		///<summary>
+		/// Apply a force at a point, adding the torque it causes around the body's center.
+		/// The center is passed in, as the transform can move in memory when the ECS reorders its storage.
+		///</summary>
+		///<param name="center">The position of the body's transform.</param>
+		///<param name="pos">The point the force acts on, in world space.</param>
+		///<param name="force">The force.</param>
+		void applyForce(glm::vec2 center, glm::vec2 pos, glm::vec2 force);
+
+		///<summary>
+		/// Wake the body up, e.g. after moving its transform.
+		///</summary>
+		void wake();
+	};
+
+	///<summary>
+	/// The state of all bodies during a step, stored as a structure of arrays so that the integration processes
+	/// 8 bodies per instruction with AVX, or 4 with SSE2. Bodies with a mass or moment of inertia of 0 do not react to forces.
+	///</summary>
+	struct BodyStore {
+		std::vector<float> pos_x, pos_y, angle;
+		std::vector<float> vel_x, vel_y, angular_velocity;
+		std::vector<float> force_x, force_y, torque;
+		std::vector<float> inverse_mass, inverse_inertia;
+
+		///<summary>
+		/// The sine and cosine of every body's angle at the start of the update.
+		///</summary>
+		std::vector<float> sines, cosines;
+
+		///<summary>
+		/// The amount of bodies. WARNING: READ-ONLY!
+		///</summary>
+		u32 size = 0;
+
+		BodyStore() = default;
+
+		void resize(u32 count);
+
+		///<summary>
+		/// Whether a body reacts to forces at all. Contacts never write to bodies that do not.
+		///</summary>
+		bool isDynamic(u32 body) const;
+
+		///<summary>
+		/// Apply gravity and the forces to the velocities. The forces are kept, as they act during every substep of a step.
+		///</summary>
+		///<param name="dt">The step size.</param>
+		///<param name="count">The amount of bodies to integrate, starting at the first one.</param>
+		///<param name="gravity">The acceleration of every body with a mass.</param>
+		void integrateVelocities(float dt, u32 count, glm::vec2 gravity);
+
+		///<summary>
+		/// Apply the velocities to the positions and angles.
+		///</summary>
+		///<param name="dt">The step size.</param>
+		///<param name="count">The amount of bodies to integrate, starting at the first one.</param>
+		void integratePositions(float dt, u32 count);
+	};
+
+	///<summary>
+	/// A touching pair of bodies, as indices into PhysicsSystem::bodies.
+	///</summary>
+	struct Contact {
+		u32 a, b;
+		Manifold manifold;
+
+		///<summary>
+		/// The impulses accumulated by the solver at every point, along the normal and along the tangent.
+		///</summary>
+		float normal_impulses[2], tangent_impulses[2];
 
-		void applyForce(glm::vec2 pos, glm::vec2 force);
+		///<summary>
+		/// The offsets of every point from the centers of both bodies.
+		///</summary>
+		glm::vec2 offsets_a[2], offsets_b[2];
 
-		void runStep(float dt, flo::TransformComponent& transform);
+		///<summary>
+		/// The effective masses of every point along the normal and the tangent, and the velocity that pushes the bodies apart.
+		///</summary>
+		float normal_masses[2], tangent_masses[2], biases[2];
 
-		void handle_collision(PhysicsComponent& other, float dt);
+		///<summary>
+		/// For two points, the matrix coupling their normal impulses (k11, k12, k22) and its inverse, so that both are solved at once.
+		/// If the matrix is too badly conditioned, block_solve is false and the points are solved one after another.
+		///</summary>
+		float normal_matrix[3], inverse_normal_matrix[3];
+		bool block_solve = false;
 
-		glm::vec2 impulse_vector(glm::vec2 pos);
+		///<summary>
+		/// For contacts with the tilemap, the coordinates of the chunk holding the top left tile of the solid run the merged box belongs to,
+		/// packed with the position of that tile within the chunk; 0 otherwise. Unlike the box, which is clipped to the body,
+		/// it does not change while the body moves along the tiles of a chunk.
+		///</summary>
+		u64 tile_box = 0;
+	};
+
+	///<summary>
+	/// The impulses of a contact, kept from one step to the next to warm start the solver.
+	///</summary>
+	struct CachedContact {
+		Entity a, b;
+		u32 point_count;
+		u32 features[2];
+		float normal_impulses[2], tangent_impulses[2];
+		u64 tile_box;
+	};
+
+	///<summary>
+	/// A set of dynamic bodies connected by contacts. Immovable bodies do not connect islands, so a pile resting on the
+	/// ground is an island of its own. Islands share no writable state and are solved independently.
+	///</summary>
+	struct Island {
+		///<summary>
+		/// The range of the island's bodies in PhysicsSystem::island_bodies.
+		///</summary>
+		u32 body_begin = 0, body_count = 0;
 
-		void collectVertices();
+		///<summary>
+		/// The range of the island's contacts in PhysicsSystem::island_contacts.
+		///</summary>
+		u32 contact_begin = 0, contact_count = 0;
 	};
 
+	///<summary>
+	/// The transform and collider a body's world vertices and bounds have been computed from.
+	///</summary>
+	struct FittedBody {
+		glm::vec2 pos, size;
+		float angle;
+		u32 shape;
+	};
+
+	///<summary>
+	/// How PhysicsSystem finds the pairs of bodies that might collide.
+	///</summary>
+	enum BroadphaseType {
+		///<summary> A uniform grid, best for bodies of similar size. </summary>
+		broadphase_spatial_hash = 0,
+		///<summary> The DynamicTree that also serves the queries, best for bodies of very different sizes. </summary>
+		broadphase_tree = 1
+	};
+
+	///<summary>
+	/// The physics simulation. Every update advances it by whole steps of fixed_dt, carrying the remaining time over
+	/// to the next update, so the simulation does not depend on the frame rate. Rendering should use interpolate(),
+	/// which blends the last two steps so that motion stays smooth when frames and steps do not line up.
+	///</summary>
 	struct PhysicsSystem : public flo::System {
-		flo::ComponentBundleArray physics_components;
+		///<summary>
+		/// The bodies gathered during the last update. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<std::pair<TransformComponent*, PhysicsComponent*>> bodies;
+
+		///<summary>
+		/// The entity of every body gathered during the last update. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<Entity> entities;
+
+		///<summary>
+		/// The duration of one step.
+		///</summary>
+		float fixed_dt = 1.f / 60.f;
+
+		///<summary>
+		/// The amount of substeps every step is divided into. More substeps make fast and stacked bodies more stable.
+		///</summary>
+		u32 substeps = 1;
+
+		///<summary>
+		/// The most steps taken in one update. Time beyond that is dropped, so that a slow frame does not make the next one slower still.
+		///</summary>
+		u32 max_steps = 4;
+
+		///<summary>
+		/// The time that has not yet been simulated. WARNING: READ-ONLY!
+		///</summary>
+		float accumulator = 0;
+
+		///<summary>
+		/// How far the time of the last update lies between the last two steps, from 0 to 1. WARNING: READ-ONLY!
+		///</summary>
+		float alpha = 1;
+
+		///<summary>
+		/// The amount of steps taken during the last update. WARNING: READ-ONLY!
+		///</summary>
+		u32 steps_taken = 0;
+
+		///<summary>
+		/// The amount of bodies that were awake and movable during the last update. They come first in bodies, followed by the sleeping and the immovable ones. WARNING: READ-ONLY!
+		///</summary>
+		u32 active_count = 0;
+
+		///<summary>
+		/// Whether islands that have come to rest are put to sleep.
+		///</summary>
+		bool allow_sleeping = true;
+
+		///<summary>
+		/// The speed and angular speed below which a body counts as resting.
+		///</summary>
+		float linear_sleep_tolerance = .01f, angular_sleep_tolerance = .035f;
+
+		///<summary>
+		/// How long every body of an island has to rest before the island is put to sleep.
+		///</summary>
+		float time_to_sleep = .5f;
+
+		///<summary>
+		/// The colliders shared by all bodies, referenced by PhysicsComponent::shape.
+		///</summary>
+		std::vector<Collider> shapes;
+
+		///<summary>
+		/// The state of the bodies during the last update, in the order of bodies. WARNING: READ-ONLY!
+		///</summary>
+		BodyStore store;
+
+		BroadphaseType broadphase_type = broadphase_spatial_hash;
+
+		///<summary>
+		/// The grid used if broadphase_type is broadphase_spatial_hash.
+		///</summary>
+		SpatialHash spatial_hash;
+
+		///<summary>
+		/// A tree of the bounds of all bodies, updated at the start of every update. Its leaves hold the entities. WARNING: READ-ONLY!
+		///</summary>
+		DynamicTree tree;
+
+		///<summary>
+		/// The tree leaf of every entity. WARNING: READ-ONLY!
+		///</summary>
+		SparseIndex proxies;
+
+		///<summary>
+		/// The index into bodies of every tree leaf during the last update. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u32> proxy_bodies;
+
+		///<summary>
+		/// The bounds of every body during the last update, fitted to its world vertices. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<AABB> bounds;
+
+		///<summary>
+		/// The collider vertices and edge normals of all bodies in world space, computed once at the start of every update. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<glm::vec2> world_vertices, world_normals;
+
+		///<summary>
+		/// The index of every body's first vertex in world_vertices, plus the total amount of vertices at the end. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u32> vertex_offsets;
+
+		///<summary>
+		/// What the world vertices and bounds of every body have been computed from. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<FittedBody> fitted_bodies;
+
+		///<summary>
+		/// Whether the world vertices and bounds of every body have been kept from the previous substep, because the body is passive and has not moved.
+		/// The tree leaves of such bodies are not refit. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u8> unmoved;
+
+		///<summary>
+		/// The candidate pairs of the last update, as indices into bodies packed like SpatialHash::findPairs() does. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u64> pairs;
+
+		///<summary>
+		/// The contacts of the last update, in the order of pairs. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<Contact> contacts;
+
+		///<summary>
+		/// The islands of the last update, ordered by their lowest body index. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<Island> islands;
+
+		///<summary>
+		/// The bodies and contacts grouped by island, each group in ascending order. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u32> island_bodies, island_contacts;
+
+		///<summary>
+		/// The island of every body, invalid_index for bodies that are not dynamic. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<u32> body_islands;
+
+		///<summary>
+		/// The least amount of contacts for which the islands are solved on the ecs' thread pool, if it has one.
+		/// Every island is solved by one thread in a fixed order, so the result does not depend on the amount of threads.
+		///</summary>
+		u32 min_parallel_contacts = 256;
+
+		///<summary>
+		/// How often the contacts of an island are solved per substep. Each pass refines the accumulated impulses; tall stacks need more passes to come to rest.
+		///</summary>
+		u32 velocity_iterations = 8;
+
+		///<summary>
+		/// The acceleration of all bodies with a mass. Unlike forces applied through PhysicsComponent::applyForce(), it does not keep bodies awake.
+		///</summary>
+		glm::vec2 gravity = glm::vec2(0.);
+
+		///<summary>
+		/// The friction coefficient of all contacts.
+		///</summary>
+		float friction = .4f;
+
+		///<summary>
+		/// The fraction of the penetration beyond linear_slop that is corrected per substep.
+		///</summary>
+		float baumgarte = .2f;
+
+		///<summary>
+		/// The penetration that is tolerated and the gap up to which bodies still touch, so that resting contacts persist instead of flickering.
+		///</summary>
+		float linear_slop = .005f;
+
+		///<summary>
+		/// Whether the solver starts from the impulses of the previous step. This lets stacks settle within few iterations.
+		///</summary>
+		bool warm_starting = true;
+
+		///<summary>
+		/// The impulses of the last step's contacts, sorted by entities. WARNING: READ-ONLY!
+		///</summary>
+		std::vector<CachedContact> contact_cache;
+
+		///<summary>
+		/// The tilemap bodies collide with, or nullptr. Its solid tiles act as immovable boxes, each centered on its tile
+		/// coordinates times TILE_SPRITE_SIZE like the rendered tiles. Chunks that are not loaded have no solid tiles. It must not be changed while the system updates.
+		///</summary>
+		InfiniteTileHandler* tilemap = nullptr;
+
+		///<summary>
+		/// Whether each tile type is solid, indexed by the type. WARNING: READ-ONLY! Use setTileSolid().
+		///</summary>
+		std::vector<u8> solid_tiles;
+
+		///<summary>
+		/// The immovable stand-in body that contacts with the tilemap refer to, placed after the gathered bodies in the store. WARNING: READ-ONLY!
+		///</summary>
+		u32 tile_body = 0;
 
 		PhysicsSystem() = default;
 
@@ -60,6 +470,166 @@ namespace flo {
 
 		virtual void entityDestroyed(Entity entity) override;
 
-		void update(float dt);
+		///<summary>
+		/// Advance the simulation by as many fixed steps as fit into the accumulated time.
+		///</summary>
+		///<param name="dt">The frame time.</param>
+		virtual void update(float dt) override;
+
+		///<summary>
+		/// Blend a body's transform between the last two steps according to alpha, for rendering.
+		///</summary>
+		///<param name="transform">The transform of the body.</param>
+		///<param name="body">The body.</param>
+		///<returns>A copy of the transform with the blended position and angle.</returns>
+		TransformComponent interpolate(const TransformComponent& transform, const PhysicsComponent& body) const;
+
+		///<summary>
+		/// Add a collider to the shared shapes.
+		///</summary>
+		///<param name="collider">The collider.</param>
+		///<returns>The index to assign to PhysicsComponent::shape.</returns>
+		u32 addShape(const Collider& collider);
+
+		///<summary>
+		/// Find all bodies whose bounds overlap a region, as of the start of the last update.
+		///</summary>
+		///<param name="region">The region in world space.</param>
+		///<param name="result">Outputs the entities. The vector is not cleared.</param>
+		void queryRegion(const AABB& region, std::vector<Entity>& result);
+
+		///<summary>
+		/// Find the first body hit by a ray, testing the colliders of the bodies as of the start of the last update.
+		///</summary>
+		///<param name="origin">The start of the ray.</param>
+		///<param name="direction">The normalized direction of the ray.</param>
+		///<param name="max_distance">The length of the ray.</param>
+		///<param name="distance">Outputs the distance of the hit.</param>
+		///<returns>The entity that has been hit, 0 if there is none.</returns>
+		Entity raycast(glm::vec2 origin, glm::vec2 direction, float max_distance, float& distance);
+
+		///<summary>
+		/// Find the body whose collider is closest to a point, as of the start of the last update. Bodies containing the point have a distance of 0.
+		///</summary>
+		///<param name="point">The point.</param>
+		///<param name="max_distance">The largest distance to consider.</param>
+		///<param name="distance">Outputs the distance.</param>
+		///<returns>The closest entity, 0 if there is none within the maximum distance.</returns>
+		Entity nearest(glm::vec2 point, float max_distance, float& distance);
+
+		///<summary>
+		/// Set whether bodies collide with tiles of a type. The solidity masks of the tilemap's chunks are rebuilt on demand.
+		///</summary>
+		///<param name="type">The tile type.</param>
+		///<param name="solid">Whether the tiles are solid.</param>
+		void setTileSolid(u16 type, bool solid);
+
+	private:
+		///<summary>
+		/// The solidity of the tiles under one body, one bit per tile with every row padded to whole 32-bit words, cleared as they are merged into boxes.
+		///</summary>
+		std::vector<u32> tile_rows;
+
+		///<summary>
+		/// The unload_count of the tilemap when the sleeping bodies were last checked for tiles that have disappeared.
+		///</summary>
+		u32 seen_unload_count = 0;
+
+		///<summary>
+		/// The world vertices, normals, vertex offsets, bounds and fits of the previous substep, which passive bodies are copied from.
+		///</summary>
+		std::vector<glm::vec2> previous_vertices, previous_normals;
+		std::vector<u32> previous_offsets;
+		std::vector<AABB> previous_bounds;
+		std::vector<FittedBody> previous_fits;
+
+		Entity getEntity(u32 body) const;
+
+		///<summary>
+		/// Find the contacts of all awake bodies with the tilemap. Only the tiles under a body's bounds are tested, merged into as few boxes as possible.
+		/// Sleeping bodies on chunks whose tiles have changed are woken, and after chunks have been unloaded, so are those over missing chunks.
+		///</summary>
+		void collideTiles();
+
+		///<summary>
+		/// Collect the bodies from the ecs, the awake and movable ones first.
+		///</summary>
+		void gatherBodies();
+
+		///<summary>
+		/// Sort the bodies of the previous substep into awake and passive ones again, as bodies may have fallen asleep or been woken.
+		///</summary>
+		void partitionBodies();
+
+		///<summary>
+		/// Run one substep: gather the bodies, find and resolve the contacts and integrate. The bodies are collected from the ecs once per step.
+		///</summary>
+		///<param name="dt">The substep size.</param>
+		///<param name="first_substep">Whether this is the first substep of a step, which records the previous transforms.</param>
+		///<param name="last_substep">Whether this is the last substep of a step, which clears the forces of the bodies.</param>
+		void step(float dt, bool first_substep, bool last_substep);
+
+		///<summary>
+		/// Copy the state of the gathered bodies into the store.
+		///</summary>
+		void loadBodies(bool first_substep);
+
+		///<summary>
+		/// Copy the state in the store back into the components.
+		///</summary>
+		///<param name="last_substep">Whether the forces of the bodies are cleared, which happens after the last substep of a step.</param>
+		void storeBodies(bool last_substep);
+
+		///<summary>
+		/// Compute the effective masses and biases of a contact and, if warm starting, apply the cached impulses.
+		///</summary>
+		void prepareContact(Contact& contact, float dt);
+
+		///<summary>
+		/// Run one solver iteration on a contact: clamp the accumulated impulses and apply their change.
+		///</summary>
+		void solveContact(Contact& contact);
+
+		///<summary>
+		/// Get the velocity of the second body relative to the first one at a point of a contact.
+		///</summary>
+		glm::vec2 getRelativeVelocity(const Contact& contact, u32 point) const;
+
+		void applyImpulse(const Contact& contact, u32 point, glm::vec2 impulse);
+
+		///<summary>
+		/// Replace the contact cache with the impulses of the current contacts.
+		///</summary>
+		void updateContactCache();
+
+		///<summary>
+		/// Group the dynamic bodies and the contacts into islands.
+		///</summary>
+		void buildIslands();
+
+		///<summary>
+		/// Solve the contacts of all islands, in parallel if there are enough.
+		///</summary>
+		void solveIslands(float dt);
+
+		bool isResting(u32 body) const;
+
+		///<summary>
+		/// Advance the sleep timers of all awake bodies and put the islands to sleep in which every body has rested long enough.
+		///</summary>
+		void updateSleep(float dt);
+
+		///<summary>
+		/// Insert new bodies into the tree, move the leaves of the others and drop those of bodies that are gone,
+		/// waking the sleeping bodies that overlapped them.
+		///</summary>
+		void updateTree(float dt);
+
+		void findTreePairs();
+
+		///<summary>
+		/// Transform the colliders of all bodies into world space and fit their bounds. Passive bodies that have not moved since the previous substep keep theirs.
+		///</summary>
+		void collectWorldVertices();
 	};
 }
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define FLO_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX__)
+#define FLO_AVX 1
+#include <immintrin.h>
+#endif
+
+namespace flo {
+#ifdef FLO_SSE2
+	///<summary>
+	/// Compute the sine and cosine of four angles at once. The angles are reduced to [-pi/4, pi/4] and approximated by the Cephes polynomials,
+	/// which is accurate to about 1e-7 for angles of moderate size (|angle| below about 8192).
+	///</summary>
+	///<param name="angles">The angles in radians.</param>
+	///<param name="sines">Outputs the sines.</param>
+	///<param name="cosines">Outputs the cosines.</param>
+	inline void sin_cos_4(__m128 angles, __m128& sines, __m128& cosines) {
+		const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+		__m128 sign_sin = _mm_and_ps(angles, sign_mask);
+		__m128 x = _mm_andnot_ps(sign_mask, angles);
+
+		//find the octant, rounded up to an even one
+		__m128i octant = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+		octant = _mm_and_si128(_mm_add_epi32(octant, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+		const __m128 y = _mm_cvtepi32_ps(octant);
+
+		const __m128 swap_sign_sin = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(octant, _mm_set1_epi32(4)), 29));
+		const __m128 sign_cos = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(octant, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+		const __m128 use_cos_polynomial = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(octant, _mm_set1_epi32(2)), _mm_setzero_si128()));
+		sign_sin = _mm_xor_ps(sign_sin, swap_sign_sin);
+
+		//subtract octant * pi/4 in three steps to keep the precision
+		x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(-0.78515625f)));
+		x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(-2.4187564849853515625e-4f)));
+		x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(-3.77489497744594108e-8f)));
+		const __m128 z = _mm_mul_ps(x, x);
+
+		__m128 cos_polynomial = _mm_set1_ps(2.443315711809948e-5f);
+		cos_polynomial = _mm_add_ps(_mm_mul_ps(cos_polynomial, z), _mm_set1_ps(-1.388731625493765e-3f));
+		cos_polynomial = _mm_add_ps(_mm_mul_ps(cos_polynomial, z), _mm_set1_ps(4.166664568298827e-2f));
+		cos_polynomial = _mm_mul_ps(_mm_mul_ps(cos_polynomial, z), z);
+		cos_polynomial = _mm_add_ps(_mm_sub_ps(cos_polynomial, _mm_mul_ps(z, _mm_set1_ps(.5f))), _mm_set1_ps(1.f));
+
+		__m128 sin_polynomial = _mm_set1_ps(-1.9515295891e-4f);
+		sin_polynomial = _mm_add_ps(_mm_mul_ps(sin_polynomial, z), _mm_set1_ps(8.3321608736e-3f));
+		sin_polynomial = _mm_add_ps(_mm_mul_ps(sin_polynomial, z), _mm_set1_ps(-1.6666654611e-1f));
+		sin_polynomial = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sin_polynomial, z), x), x);
+
+		const __m128 sin_result = _mm_or_ps(_mm_and_ps(use_cos_polynomial, sin_polynomial), _mm_andnot_ps(use_cos_polynomial, cos_polynomial));
+		const __m128 cos_result = _mm_or_ps(_mm_and_ps(use_cos_polynomial, cos_polynomial), _mm_andnot_ps(use_cos_polynomial, sin_polynomial));
+		sines = _mm_xor_ps(sin_result, sign_sin);
+		cosines = _mm_xor_ps(cos_result, sign_cos);
+	}
+#endif
+
+	///<summary>
+	/// Compute the sine and cosine of many angles, four at a time where SSE2 is available.
+	///</summary>
+	///<param name="angles">The angles in radians.</param>
+	///<param name="count">The amount of angles.</param>
+	///<param name="sines">Outputs the sines.</param>
+	///<param name="cosines">Outputs the cosines.</param>
+	inline void sin_cos(const float* angles, unsigned int count, float* sines, float* cosines) {
+		unsigned int i = 0;
+#ifdef FLO_SSE2
+		for (; i + 4 <= count; i += 4) {
+			__m128 s, c;
+			sin_cos_4(_mm_loadu_ps(angles + i), s, c);
+			_mm_storeu_ps(sines + i, s);
+			_mm_storeu_ps(cosines + i, c);
+		}
+#endif
+		for (; i < count; ++i) {
+			sines[i] = std::sin(angles[i]);
+			cosines[i] = std::cos(angles[i]);
+		}
+	}
+}
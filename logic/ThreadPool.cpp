@@ -0,0 +1,138 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace flo {
+	thread_local ThreadPool* current_pool = nullptr;
+	thread_local u32 current_queue = 0;
+
+	ThreadPool::ThreadPool(u32 thread_count) :
+	pending(0), waiting(0), stopping(false) {
+		if (thread_count == 0) thread_count = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+		//queue 0 is shared by all threads that are not workers
+		for (u32 i = 0; i <= thread_count; ++i) queues.push_back(new TaskQueue());
+		for (u32 i = 1; i <= thread_count; ++i) threads.push_back(new std::thread(&ThreadPool::work, this, i));
+	}
+
+	u32 ThreadPool::getThreadCount() {
+		return threads.size();
+	}
+
+	u32 ThreadPool::currentQueue() {
+		return current_pool == this ? current_queue : 0;
+	}
+
+	void ThreadPool::submit(Task task) {
+		TaskQueue* queue = queues[currentQueue()];
+		//counted before it is visible, so that a thief cannot take it first and let the counter underflow
+		++pending;
+		{
+			std::lock_guard<std::mutex> lock(queue->mutex);
+			queue->tasks.push_back(std::move(task));
+		}
+		{
+			//taking the lock ensures a worker cannot miss the notification between checking and sleeping
+			std::lock_guard<std::mutex> lock(sleep_mutex);
+		}
+		wake.notify_one();
+	}
+
+	bool ThreadPool::runPending(u32 queue_index) {
+		Task task;
+		{
+			//own tasks are taken from the back, as they are most likely still in the cache
+			TaskQueue* own = queues[queue_index];
+			std::lock_guard<std::mutex> lock(own->mutex);
+			if (!own->tasks.empty()) {
+				task = std::move(own->tasks.back());
+				own->tasks.pop_back();
+			}
+		}
+		for (u32 i = 1; i < queues.size() && !task; ++i) {
+			//other tasks are stolen from the front
+			TaskQueue* victim = queues[(queue_index + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(victim->mutex);
+			if (!victim->tasks.empty()) {
+				task = std::move(victim->tasks.front());
+				victim->tasks.pop_front();
+			}
+		}
+		if (!task) return false;
+		--pending;
+		task();
+		if (waiting > 0) {
+			{
+				std::lock_guard<std::mutex> lock(sleep_mutex);
+			}
+			finished.notify_all();
+		}
+		return true;
+	}
+
+	void ThreadPool::work(u32 queue_index) {
+		current_pool = this;
+		current_queue = queue_index;
+		while (!stopping) {
+			if (runPending(queue_index)) continue;
+			std::unique_lock<std::mutex> lock(sleep_mutex);
+			wake.wait(lock, [this]() { return stopping || pending > 0; });
+		}
+	}
+
+	void ThreadPool::wait(std::atomic<u32>& counter) {
+		const u32 queue_index = currentQueue();
+		u32 idle = 0;
+		while (counter > 0) {
+			if (runPending(queue_index)) {
+				idle = 0;
+				continue;
+			}
+			//the last tasks are usually about to finish, so spin briefly before blocking
+			if (++idle < 64) {
+				std::this_thread::yield();
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(sleep_mutex);
+			++waiting;
+			//the timeout covers counters decremented outside of pool tasks and tasks submitted meanwhile
+			finished.wait_for(lock, std::chrono::milliseconds(1), [&]() { return counter == 0 || pending > 0; });
+			--waiting;
+		}
+	}
+
+	void ThreadPool::parallelFor(u32 count, u32 batch_size, const std::function<void(u32 begin, u32 end)>& function) {
+		if (count == 0) return;
+		batch_size = std::max(batch_size, 1u);
+		const u32 batches = (count + batch_size - 1) / batch_size;
+		if (batches == 1 || threads.empty()) {
+			function(0, count);
+			return;
+		}
+
+		std::atomic<u32> remaining(batches);
+		for (u32 b = 0; b < batches; ++b) {
+			submit([&, b]() {
+				function(b * batch_size, std::min((b + 1) * batch_size, count));
+				--remaining;
+			});
+		}
+		wait(remaining);
+	}
+
+	void ThreadPool::dispose() {
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (int i = 0; i < threads.size(); ++i) {
+			if (threads[i]->joinable()) threads[i]->join();
+			delete threads[i];
+		}
+		threads.clear();
+		for (int i = 0; i < queues.size(); ++i) delete queues[i];
+		queues.clear();
+	}
+}
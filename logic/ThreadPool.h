@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+#include "Types.h"
+
+namespace flo {
+	///<summary>
+	/// A pool of worker threads. Every worker owns a queue of tasks and steals from the other queues once its own is empty.
+	///</summary>
+	struct ThreadPool {
+		typedef std::function<void()> Task;
+
+	protected:
+		struct TaskQueue {
+			std::deque<Task> tasks;
+			std::mutex mutex;
+		};
+
+		std::vector<std::thread*> threads;
+		std::vector<TaskQueue*> queues;
+		std::atomic<u32> pending, waiting;
+		std::mutex sleep_mutex;
+		std::condition_variable wake, finished;
+		std::atomic<bool> stopping;
+
+		void work(u32 queue_index);
+
+		bool runPending(u32 queue_index);
+
+		u32 currentQueue();
+
+	public:
+		///<summary>
+		/// Create a pool and start its workers.
+		///</summary>
+		///<param name="thread_count">The amount of workers. If 0, one worker less than the amount of hardware threads is used, as the caller helps while waiting.</param>
+		ThreadPool(u32 thread_count = 0);
+
+		ThreadPool(const ThreadPool&) = delete;
+
+		///<summary>
+		/// The amount of worker threads.
+		///</summary>
+		///<returns>The amount of worker threads.</returns>
+		u32 getThreadCount();
+
+		///<summary>
+		/// Queue a task. When called from a worker, the task is put into that worker's queue.
+		///</summary>
+		///<param name="task">The task to run.</param>
+		void submit(Task task);
+
+		///<summary>
+		/// Run queued tasks on the calling thread until a counter reaches zero. Once there is nothing left to run, the thread blocks until a task finishes.
+		///</summary>
+		///<param name="counter">The counter to wait for. It is expected to be decremented by tasks.</param>
+		void wait(std::atomic<u32>& counter);
+
+		///<summary>
+		/// Split a range into batches and run them on the pool. Returns once all batches are done; the calling thread helps.
+		///</summary>
+		///<param name="count">The size of the range.</param>
+		///<param name="batch_size">The amount of elements per batch.</param>
+		///<param name="function">The function to run with the first and one past the last index of each batch.</param>
+		void parallelFor(u32 count, u32 batch_size, const std::function<void(u32 begin, u32 end)>& function);
+
+		///<summary>
+		/// Stop and join all workers. Queued tasks that have not been started are discarded.
+		///</summary>
+		void dispose();
+	};
+}
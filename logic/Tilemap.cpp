@@ -114,6 +114,7 @@ namespace flo {
 	void Chunk::setTile(int x, int y, short tile) {
 		if (x < 0 || x >= size || y < 0 || y >= size) return;
 		remesh_needed = true;
+		solid_mask_needed = true;
 		tiles[x + y * size] = tile;
 		if (!parent) return;
 		int xpre = 100, ypre = 100;
@@ -134,6 +135,21 @@ namespace flo {
 		}
 	}
 
+	const u32* Chunk::getSolidMask(const std::vector<u8>& solid_types) {
+		if (!solid_mask_needed) return solid_mask.data();
+		const int row_words = (size + 31) / 32;
+		solid_mask.assign(row_words * size, 0);
+		for (int y = 0; y < size; ++y) {
+			u32* row = solid_mask.data() + y * row_words;
+			for (int x = 0; x < size; ++x) {
+				const TileType type = tiles[x + y * size];
+				if (type < solid_types.size() && solid_types[type]) row[x >> 5] |= 1u << (x & 31);
+			}
+		}
+		solid_mask_needed = false;
+		return solid_mask.data();
+	}
+
 	void Chunk::queueRemesh(int x, int y) {
 		if (x < 0 || x >= size || y < 0 || y >= size) return;
 		tiles[x + y * size + tilecount] |= 1 << 15;
@@ -395,6 +411,8 @@ namespace flo {
 		for (int i = 0; i < chunk_x_count * chunk_x_count; ++i) {
 			chunk_indices[i] = -1;
 		}
+		//the chunks cannot be found until the focus moves again
+		++unload_count;
 	}
 
 	void InfiniteTileHandler::update(const glm::mat3& transformations, const glm::mat3& transformations_inverse) {
@@ -514,6 +532,7 @@ namespace flo {
 			else {
 				if (!save) chunk.unload();
 				else save_queue.push_back(chunk);
+				++unload_count;
 
 				chunks.erase(chunks.begin() + i);
 				--i;
@@ -147,6 +147,13 @@ namespace flo {
 		fgr::SpriteArray sprites;
 		bool remesh_needed, update_needed = false, inited = false;
 
+		///<summary>
+		/// One bit per tile, set for solid tiles, row by row with every row padded to whole 32-bit words.
+		/// WARNING: READ-ONLY! Use getSolidMask(), which rebuilds it after tiles have changed.
+		///</summary>
+		std::vector<u32> solid_mask;
+		bool solid_mask_needed = true;
+
 		///<summary>
 		/// If not a nullptr, this is a reference to the InfiniteTileHandler this chunk is part of.
 		/// WARNING: READ-ONLY!
@@ -194,6 +201,13 @@ namespace flo {
 		///<param name="tile">The tile type to set.</param>
 		void setTile(int x, int y, short tile);
 
+		///<summary>
+		/// Get the solidity of all tiles as a bitmask, rebuilding it if tiles have changed since it was last built.
+		///</summary>
+		///<param name="solid_types">Whether each tile type is solid, indexed by the type. Types beyond its end are not solid.</param>
+		///<returns>The mask, with (size + 31) / 32 words per row.</returns>
+		const u32* getSolidMask(const std::vector<u8>& solid_types);
+
 		///<summary>
 		/// Unload the chunk from existance.
 		///</summary>
@@ -266,6 +280,12 @@ namespace flo {
 		///</summary>
 		TileSet tileset;
 
+		///<summary>
+		/// Increased whenever chunks are unloaded, so that systems relying on the tiles can tell that some have disappeared.
+		/// WARNING: READ-ONLY!
+		///</summary>
+		u32 unload_count = 0;
+
 		InfiniteTileHandler() = default;
 
 		///<summary>
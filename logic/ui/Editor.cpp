@@ -13,33 +13,32 @@
 
 namespace fui {
 	struct EditorSystem : public flo::System {
-		flo::ComponentBundleArray cba;
-
 		EditorSystem() = default;
 
 		virtual void onRegistered() override {
 			parent_ecs->registerComponent(TYPEHASH(flo::TransformComponent));
-			cba = flo::ComponentBundleArray(std::vector<typehash>{TYPEHASH(flo::TransformComponent)}, * parent_ecs);
+			declareReads<flo::TransformComponent>();
 		}
 
 		virtual void entityAdded(flo::Entity entity) override {
-			cba.onAdded(entity);
 		}
 
 		virtual void entityDestroyed(flo::Entity entity) override {
-			cba.onRemoved(entity);
 		}
 
 		flo::TransformComponent* update(glm::vec2 mp) {
-			for (int i = 0; i < cba.size(); ++i) {
-				flo::TransformComponent& tc = *((flo::TransformComponent*)cba.getComponent(0, i));
+			//the editor is driven without runSystems(), so the systems have to be told about new and removed entities here
+			parent_ecs->notifySystems();
+			//picking only reads the transforms, so a const view keeps them from all being marked as changed
+			const flo::TransformComponent* result = nullptr;
+			parent_ecs->view<const flo::TransformComponent>().each([&](flo::Entity entity, const flo::TransformComponent& tc) {
 				glm::vec2 p0 = tc.pos - tc.size;
 				glm::vec2 p1 = tc.pos + tc.size;
-				if (mp.x > p0.x && mp.x < p1.x && mp.y > p0.y && mp.y < p1.y) {
-					return &tc;
+				if (!result && mp.x > p0.x && mp.x < p1.x && mp.y > p0.y && mp.y < p1.y) {
+					result = &tc;
 				}
-			}
-			return nullptr;
+			});
+			return const_cast<flo::TransformComponent*>(result);
 		}
 	};
 